@@ -0,0 +1,107 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "numbers.h"
+
+#define ITERATIONS 2000000
+#define ROW_SIZE 64
+
+// Keeps the compiler from optimizing the measured work away
+static volatile size_t sink;
+
+static double elapsed_ms(struct timespec start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+static void report(const char *name, double libc_ms, double kernel_ms) {
+  printf("%-24s libc %8.2f ms  kernel %8.2f ms  speedup %5.2fx\n", name, libc_ms, kernel_ms, libc_ms / kernel_ms);
+}
+
+// Compares the integer kernels of numbers.c against the libc functions they replace.
+int main(void) {
+  unsigned int *values = malloc(ITERATIONS * sizeof(unsigned int));
+  char *text = malloc(ITERATIONS * (MAX_UINT_DIGITS + 1));
+
+  if (values == NULL || text == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return 1;
+  }
+
+  srand(42);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    values[i] = (unsigned int)rand() % 100000;
+  }
+
+  char out[ROW_SIZE * (MAX_UINT_DIGITS + 1) + 1];
+  struct timespec start;
+  size_t total = 0;
+
+  // Single numbers
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    total += (size_t)sprintf(out, "%u", values[i]);
+  }
+  double libc_ms = elapsed_ms(start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    total += format_uint(values[i], out);
+  }
+  report("format_uint", libc_ms, elapsed_ms(start));
+
+  // Rows of a mostly empty event, as printed by SHOW
+  unsigned int row[ROW_SIZE];
+  for (size_t i = 0; i < ROW_SIZE; i++) {
+    row[i] = i % 7 == 0 ? (unsigned int)i : 0;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ITERATIONS / ROW_SIZE; i++) {
+    size_t len = 0;
+    for (size_t j = 0; j < ROW_SIZE; j++) {
+      if (j > 0) out[len++] = ' ';
+      len += (size_t)sprintf(out + len, "%u", row[j]);
+    }
+    total += len;
+  }
+  libc_ms = elapsed_ms(start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < ITERATIONS / ROW_SIZE; i++) {
+    total += format_uint_row(row, ROW_SIZE, out);
+  }
+  report("format_uint_row", libc_ms, elapsed_ms(start));
+
+  // Parsing, on the numbers written one per line
+  size_t len = 0;
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    len += format_uint(values[i], text + len);
+    text[len++] = '\n';
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (char *current = text, *end = text + len; current < end;) {
+    char *next;
+    total += strtoul(current, &next, 10);
+    current = next + 1;
+  }
+  libc_ms = elapsed_ms(start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t pos = 0; pos < len;) {
+    uint64_t value;
+    pos += parse_digits(text + pos, len - pos, &value) + 1;
+    total += value;
+  }
+  report("parse_digits", libc_ms, elapsed_ms(start));
+
+  sink = total;
+  free(values);
+  free(text);
+  return 0;
+}
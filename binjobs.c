@@ -0,0 +1,339 @@
+#include "binjobs.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "constants.h"
+#include "filehandler.h"
+
+// Growable buffer used to encode a segment before writing it
+struct ByteBuffer {
+  unsigned char *data;
+  size_t len;
+  size_t capacity;
+};
+
+/// Makes sure the buffer has room for n more bytes.
+/// @param buffer Buffer to be grown.
+/// @param n Number of bytes needed.
+/// @return 0 if there is enough space, 1 if memory ran out.
+static int grow(struct ByteBuffer *buffer, size_t n) {
+  if (buffer->capacity - buffer->len >= n) return 0;
+
+  size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+  while (capacity - buffer->len < n) capacity *= 2;
+
+  unsigned char *data = realloc(buffer->data, capacity);
+  if (data == NULL) return 1;
+
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 0;
+}
+
+static void put_u32(unsigned char *out, uint32_t value) {
+  out[0] = (unsigned char)value;
+  out[1] = (unsigned char)(value >> 8);
+  out[2] = (unsigned char)(value >> 16);
+  out[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t get_u32(const unsigned char *in) {
+  return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+/// Appends a value as a LEB128 varint.
+/// @note The buffer must have room for 5 more bytes.
+static void put_varint(struct ByteBuffer *buffer, uint32_t value) {
+  while (value >= 0x80) {
+    buffer->data[buffer->len++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  buffer->data[buffer->len++] = (unsigned char)value;
+}
+
+/// Decodes a LEB128 varint.
+/// @param in Start of the varint.
+/// @param end End of the available data.
+/// @param value Pointer to the variable to store the value in.
+/// @return Number of bytes used, 0 if the varint is truncated or too large.
+static size_t get_varint(const unsigned char *in, const unsigned char *end, unsigned int *value) {
+  uint32_t result = 0;
+
+  for (size_t i = 0; i < 5 && in + i < end; i++) {
+    uint32_t byte = in[i] & 0x7f;
+
+    if (i == 4 && byte > 0x0f) return 0;
+
+    result |= byte << (7 * i);
+
+    if ((in[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+static enum Opcode to_opcode(enum Command cmd) {
+  switch (cmd) {
+    case CMD_CREATE:
+      return OP_CREATE;
+    case CMD_RESERVE:
+      return OP_RESERVE;
+    case CMD_SHOW:
+      return OP_SHOW;
+    case CMD_STATS:
+      return OP_STATS;
+    case CMD_LIST_EVENTS:
+      return OP_LIST_EVENTS;
+    case CMD_WAIT:
+      return OP_WAIT;
+    case CMD_BARRIER:
+      return OP_BARRIER;
+    case CMD_HELP:
+      return OP_HELP;
+    case CMD_INVALID:
+    case CMD_EMPTY:
+    case EOC:
+      return OP_INVALID;
+  }
+
+  return OP_INVALID;
+}
+
+/// Appends a fixed size record.
+/// @note The buffer must have room for BINJOBS_RECORD_SIZE more bytes.
+static void put_record(struct ByteBuffer *buffer, enum Opcode opcode, unsigned char flags, uint32_t event_id,
+                       uint32_t arg1, uint32_t arg2) {
+  unsigned char *record = buffer->data + buffer->len;
+
+  memset(record, 0, BINJOBS_RECORD_SIZE);
+  record[0] = (unsigned char)opcode;
+  record[1] = flags;
+  put_u32(record + 4, event_id);
+  put_u32(record + 8, arg1);
+  put_u32(record + 12, arg2);
+
+  buffer->len += BINJOBS_RECORD_SIZE;
+}
+
+int write_binary_header(int fd) {
+  char header[BINJOBS_HEADER_SIZE] = BINJOBS_MAGIC;
+
+  header[4] = (char)(BINJOBS_VERSION & 0xff);
+  header[5] = (char)(BINJOBS_VERSION >> 8);
+  header[6] = 0;
+  header[7] = 0;
+
+  return write_buffer(fd, header, BINJOBS_HEADER_SIZE);
+}
+
+int write_binary_segment(int fd, const struct Segment *segment) {
+  struct ByteBuffer buffer = {NULL, 0, 0};
+
+  for (size_t i = 0; i < segment->num_instructions; i++) {
+    const struct Instruction *instruction = &segment->instructions[i];
+
+    // Each coordinate takes at most 5 bytes
+    if (grow(&buffer, BINJOBS_RECORD_SIZE + 10 * instruction->num_coords) != 0) {
+      free(buffer.data);
+      return 1;
+    }
+
+    if (instruction->cmd != CMD_RESERVE) {
+      unsigned char flags = instruction->cmd == CMD_WAIT && instruction->arg2 != ALL_THREADS ? BINJOBS_FLAG_THREAD : 0;
+      put_record(&buffer, to_opcode(instruction->cmd), flags, instruction->event_id, instruction->arg1,
+                 instruction->arg2);
+      continue;
+    }
+
+    size_t record = buffer.len;
+    buffer.len += BINJOBS_RECORD_SIZE;
+
+    for (size_t j = 0; j < instruction->num_coords; j++) {
+      put_varint(&buffer, (uint32_t)segment->xs[instruction->coords + j]);
+      put_varint(&buffer, (uint32_t)segment->ys[instruction->coords + j]);
+    }
+
+    size_t coords_size = buffer.len - record - BINJOBS_RECORD_SIZE;
+
+    buffer.len = record;
+    put_record(&buffer, OP_RESERVE, 0, instruction->event_id, (uint32_t)instruction->num_coords, (uint32_t)coords_size);
+    buffer.len += coords_size;
+  }
+
+  if (segment->end == CMD_BARRIER) {
+    if (grow(&buffer, BINJOBS_RECORD_SIZE) != 0) {
+      free(buffer.data);
+      return 1;
+    }
+
+    put_record(&buffer, OP_BARRIER, 0, 0, 0, 0);
+  }
+
+  int ret = write_buffer(fd, (const char *)buffer.data, buffer.len);
+
+  free(buffer.data);
+  return ret;
+}
+
+int open_binary(struct BinaryReader *reader, int fd) {
+  struct stat file_stat;
+
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < BINJOBS_HEADER_SIZE) return 1;
+
+  reader->size = (size_t)file_stat.st_size;
+  reader->pos = BINJOBS_HEADER_SIZE;
+
+  void *data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) return 1;
+
+  reader->data = data;
+
+  if (memcmp(reader->data, BINJOBS_MAGIC, 4) != 0 || (reader->data[4] | reader->data[5] << 8) != BINJOBS_VERSION) {
+    close_binary(reader);
+    return 1;
+  }
+
+  return 0;
+}
+
+void close_binary(struct BinaryReader *reader) {
+  munmap((void *)reader->data, reader->size);
+  reader->data = NULL;
+  reader->size = 0;
+}
+
+int load_binary_instruction(struct BinaryReader *reader, struct Instruction *instruction, size_t *xs, size_t *ys) {
+  instruction->coords = 0;
+  instruction->num_coords = 0;
+
+  if (reader->pos == reader->size) {
+    instruction->cmd = EOC;
+    return 0;
+  }
+
+  if (reader->size - reader->pos < BINJOBS_RECORD_SIZE) return 1;
+
+  const unsigned char *record = reader->data + reader->pos;
+  reader->pos += BINJOBS_RECORD_SIZE;
+
+  instruction->event_id = get_u32(record + 4);
+  instruction->arg1 = get_u32(record + 8);
+  instruction->arg2 = get_u32(record + 12);
+
+  switch ((enum Opcode)record[0]) {
+    case OP_CREATE:
+      instruction->cmd = CMD_CREATE;
+      break;
+
+    case OP_RESERVE: {
+      size_t num_coords = instruction->arg1;
+      size_t coords_size = instruction->arg2;
+
+      if (num_coords == 0 || num_coords >= MAX_RESERVATION_SIZE || coords_size > reader->size - reader->pos) {
+        return 1;
+      }
+
+      const unsigned char *in = reader->data + reader->pos;
+      const unsigned char *end = in + coords_size;
+
+      for (size_t i = 0; i < num_coords; i++) {
+        unsigned int x, y;
+        size_t used;
+
+        if ((used = get_varint(in, end, &x)) == 0) return 1;
+        in += used;
+
+        if ((used = get_varint(in, end, &y)) == 0) return 1;
+        in += used;
+
+        xs[i] = (size_t)x;
+        ys[i] = (size_t)y;
+      }
+
+      if (in != end) return 1;
+
+      instruction->cmd = CMD_RESERVE;
+      instruction->num_coords = num_coords;
+      instruction->arg1 = 0;
+      instruction->arg2 = 0;
+
+      reader->pos += coords_size;
+      break;
+    }
+
+    case OP_SHOW:
+      instruction->cmd = CMD_SHOW;
+      break;
+
+    case OP_STATS:
+      instruction->cmd = CMD_STATS;
+      break;
+
+    case OP_LIST_EVENTS:
+      instruction->cmd = CMD_LIST_EVENTS;
+      break;
+
+    case OP_WAIT:
+      // Thread IDs start at 1, so a named thread 0 is as invalid as in a .jobs file
+      if ((record[1] & BINJOBS_FLAG_THREAD) == 0) {
+        instruction->cmd = CMD_WAIT;
+        instruction->arg2 = ALL_THREADS;
+      } else {
+        instruction->cmd = instruction->arg2 == ALL_THREADS ? CMD_INVALID : CMD_WAIT;
+      }
+      break;
+
+    case OP_BARRIER:
+      instruction->cmd = CMD_BARRIER;
+      break;
+
+    case OP_HELP:
+      instruction->cmd = CMD_HELP;
+      break;
+
+    case OP_INVALID:
+      instruction->cmd = CMD_INVALID;
+      break;
+
+    default:
+      return 1;
+  }
+
+  return 0;
+}
+
+int load_binary_segment(struct BinaryReader *reader, struct Segment *segment) {
+  segment->num_instructions = 0;
+  segment->num_coords = 0;
+  segment->num_chains = 0;
+  segment->num_stages = 0;
+
+  while (1) {
+    if (reserve_coords(segment) != 0) return 1;
+
+    struct Instruction loaded;
+    if (load_binary_instruction(reader, &loaded, segment->xs + segment->num_coords,
+                                segment->ys + segment->num_coords) != 0) {
+      return 1;
+    }
+
+    if (loaded.cmd == CMD_BARRIER || loaded.cmd == EOC) {
+      segment->end = loaded.cmd;
+      return 0;
+    }
+
+    struct Instruction *instruction = new_instruction(segment);
+    if (instruction == NULL) return 1;
+
+    *instruction = loaded;
+    instruction->coords = segment->num_coords;
+    segment->num_coords += loaded.num_coords;
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef EMS_BINJOBS_H
+#define EMS_BINJOBS_H
+
+#include <stddef.h>
+
+#include "segment.h"
+
+/*
+ * Binary jobs format (.bjobs)
+ *
+ * The file starts with an 8 byte header: the magic "EMSB" followed by the
+ * format version and a reserved field, both 16 bit little-endian.
+ *
+ * Every command is a fixed 16 byte record: a one byte opcode, a one byte flags
+ * field, two bytes of padding and three 32 bit little-endian fields (event ID,
+ * arg1, arg2) with the same meaning as in struct Instruction. A RESERVE stores the
+ * number of seats in arg1 and the size in bytes of its coordinate list in arg2;
+ * the list follows the record as pairs of LEB128 varints (row, column). A WAIT
+ * that names a thread sets BINJOBS_FLAG_THREAD, and its thread ID must not be 0,
+ * as in .jobs files.
+ */
+
+#define BINJOBS_MAGIC "EMSB"
+#define BINJOBS_VERSION 2
+#define BINJOBS_HEADER_SIZE 8
+#define BINJOBS_RECORD_SIZE 16
+
+#define BINJOBS_FLAG_THREAD 0x01  // The WAIT of the record names a thread
+
+// Record opcodes, fixed so that files don't depend on the order of enum Command
+enum Opcode {
+  OP_CREATE = 1,
+  OP_RESERVE = 2,
+  OP_SHOW = 3,
+  OP_LIST_EVENTS = 4,
+  OP_WAIT = 5,
+  OP_BARRIER = 6,
+  OP_HELP = 7,
+  OP_INVALID = 8,
+  OP_STATS = 9
+};
+
+// Memory mapped binary jobs file
+struct BinaryReader {
+  const unsigned char *data;  // Contents of the file
+  size_t size;                // Size of the file
+  size_t pos;                 // Offset of the next record
+};
+
+/// Writes the header of a binary jobs file.
+/// @param fd File descriptor of the binary file.
+/// @return 0 if the header was written successfully, 1 otherwise.
+int write_binary_header(int fd);
+
+/// Writes the commands of a segment followed by a barrier record if the segment
+/// ended in one.
+/// @param fd File descriptor of the binary file.
+/// @param segment Segment to be written.
+/// @return 0 if the segment was written successfully, 1 otherwise.
+int write_binary_segment(int fd, const struct Segment *segment);
+
+/// Maps a binary jobs file into memory and checks its header.
+/// @param reader Reader to be initialized.
+/// @param fd File descriptor of the binary file.
+/// @return 0 if the file was mapped successfully, 1 otherwise.
+int open_binary(struct BinaryReader *reader, int fd);
+
+/// Unmaps a binary jobs file.
+/// @param reader Reader of the file.
+void close_binary(struct BinaryReader *reader);
+
+/// Decodes the next record of a binary jobs file.
+/// @param reader Reader of the file.
+/// @param instruction Instruction to store the command in, CMD_BARRIER or EOC
+/// once the segment ends.
+/// @param xs Room for MAX_RESERVATION_SIZE rows, filled by a RESERVE.
+/// @param ys Room for MAX_RESERVATION_SIZE columns, filled by a RESERVE.
+/// @return 0 if the record was decoded successfully, 1 if the file is corrupted.
+int load_binary_instruction(struct BinaryReader *reader, struct Instruction *instruction, size_t *xs, size_t *ys);
+
+/// Decodes the records of a binary jobs file until the next barrier or the end
+/// of the file, replacing the previous contents of the segment.
+/// @param reader Reader of the file.
+/// @param segment Segment to store the commands in.
+/// @return 0 if the segment was loaded successfully, 1 if the file is corrupted
+/// or memory ran out.
+int load_binary_segment(struct BinaryReader *reader, struct Segment *segment);
+
+#endif  // EMS_BINJOBS_H
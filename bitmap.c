@@ -0,0 +1,86 @@
+#include "bitmap.h"
+
+#include <stdlib.h>
+
+bitmap_word_t *create_bitmap(size_t num_bits) {
+  size_t num_words = (num_bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+  bitmap_word_t *bitmap = malloc((num_words > 0 ? num_words : 1) * sizeof(bitmap_word_t));
+  if (!bitmap) return NULL;
+
+  for (size_t i = 0; i < num_words; i++) {
+    atomic_init(&bitmap[i], 0);
+  }
+
+  return bitmap;
+}
+
+/// Gets the mask of the bits in [from, to) of a word.
+static uint64_t word_mask(size_t from, size_t to) {
+  uint64_t high = to == BITMAP_WORD_BITS ? ~(uint64_t)0 : ((uint64_t)1 << to) - 1;
+  return high & ~(((uint64_t)1 << from) - 1);
+}
+
+void set_bits(bitmap_word_t *bitmap, const size_t *indexes, size_t n) {
+  size_t i = 0;
+
+  while (i < n) {
+    size_t word = indexes[i] / BITMAP_WORD_BITS;
+    uint64_t mask = 0;
+
+    // Gather every bit that falls in the same word
+    for (; i < n && indexes[i] / BITMAP_WORD_BITS == word; i++) {
+      mask |= (uint64_t)1 << (indexes[i] % BITMAP_WORD_BITS);
+    }
+
+    atomic_fetch_or(&bitmap[word], mask);
+  }
+}
+
+int any_bit_set(bitmap_word_t *bitmap, const size_t *indexes, size_t n) {
+  size_t i = 0;
+
+  while (i < n) {
+    size_t word = indexes[i] / BITMAP_WORD_BITS;
+    uint64_t mask = 0;
+
+    for (; i < n && indexes[i] / BITMAP_WORD_BITS == word; i++) {
+      mask |= (uint64_t)1 << (indexes[i] % BITMAP_WORD_BITS);
+    }
+
+    if (atomic_load_explicit(&bitmap[word], memory_order_acquire) & mask) return 1;
+  }
+
+  return 0;
+}
+
+size_t longest_clear_run(bitmap_word_t *bitmap, size_t start, size_t len) {
+  size_t longest = 0;
+  size_t current = 0;  // Clear bits since the last set one, carried across words
+  size_t end = start + len;
+
+  for (size_t bit = start; bit < end;) {
+    size_t word = bit / BITMAP_WORD_BITS;
+    size_t from = bit % BITMAP_WORD_BITS;
+    size_t to = end - word * BITMAP_WORD_BITS < BITMAP_WORD_BITS ? end - word * BITMAP_WORD_BITS : BITMAP_WORD_BITS;
+
+    // Sequentially consistent, so concurrent writers of a range can't both miss each other's bits
+    uint64_t set = atomic_load(&bitmap[word]) & word_mask(from, to);
+
+    while (set != 0) {
+      size_t next = (size_t)__builtin_ctzll(set);
+      current += next - from;
+      if (current > longest) longest = current;
+
+      current = 0;
+      from = next + 1;
+      set &= set - 1;
+    }
+
+    current += to - from;
+    if (current > longest) longest = current;
+
+    bit = word * BITMAP_WORD_BITS + to;
+  }
+
+  return longest;
+}
@@ -0,0 +1,39 @@
+#ifndef EMS_BITMAP_H
+#define EMS_BITMAP_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BITMAP_WORD_BITS 64
+
+typedef _Atomic uint64_t bitmap_word_t;
+
+/// Allocates a bitmap with every bit clear.
+/// @param num_bits Number of bits of the bitmap.
+/// @return Newly created bitmap, NULL on failure.
+bitmap_word_t *create_bitmap(size_t num_bits);
+
+/// Sets the bits with the given indexes, one atomic operation per word touched.
+/// @param bitmap Bitmap to be modified.
+/// @param indexes Indexes of the bits, in increasing order.
+/// @param n Number of indexes.
+void set_bits(bitmap_word_t *bitmap, const size_t *indexes, size_t n);
+
+/// Checks if any of the bits with the given indexes is set, testing a whole word
+/// of them at a time.
+/// @param bitmap Bitmap to be checked.
+/// @param indexes Indexes of the bits, in increasing order.
+/// @param n Number of indexes.
+/// @return 1 if at least one of the bits is set, 0 otherwise.
+int any_bit_set(bitmap_word_t *bitmap, const size_t *indexes, size_t n);
+
+/// Gets the length of the longest run of clear bits in a range, skipping from
+/// one set bit to the next.
+/// @param bitmap Bitmap to be checked.
+/// @param start Index of the first bit of the range.
+/// @param len Number of bits in the range.
+/// @return Number of bits of the longest run.
+size_t longest_clear_run(bitmap_word_t *bitmap, size_t start, size_t len);
+
+#endif  // EMS_BITMAP_H
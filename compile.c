@@ -0,0 +1,78 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binjobs.h"
+#include "filehandler.h"
+#include "segment.h"
+
+// Converts a textual .jobs file into the binary .bjobs format read by ems.
+// Usage: ems-compile <file.jobs> [file.bjobs]
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <file.jobs> [file.bjobs]\n", argv[0]);
+    return 1;
+  }
+
+  if (jobs_format(argv[1]) != TEXT_JOBS) {
+    fprintf(stderr, "Input must be a %s file\n", JOBS_EXTENSION);
+    return 1;
+  }
+
+  // Default output path = input path - ".jobs" + ".bjobs"
+  size_t base_len = strlen(argv[1]) - strlen(JOBS_EXTENSION);
+  char default_path[base_len + strlen(BINARY_JOBS_EXTENSION) + 1];
+  snprintf(default_path, sizeof(default_path), "%.*s%s", (int)base_len, argv[1], BINARY_JOBS_EXTENSION);
+
+  const char *out_path = argc == 3 ? argv[2] : default_path;
+
+  int fd_in = open(argv[1], O_RDONLY);
+  if (fd_in < 0) {
+    fprintf(stderr, "Failed to open %s\n", argv[1]);
+    return 1;
+  }
+
+  int fd_out = open(out_path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  if (fd_out < 0) {
+    fprintf(stderr, "Failed to create %s\n", out_path);
+    close(fd_in);
+    return 1;
+  }
+
+  struct FileReader *reader = malloc(sizeof(struct FileReader));
+  if (reader == NULL) {
+    fprintf(stderr, "Error allocating memory for reader\n");
+    return 1;
+  }
+
+  init_reader(reader, fd_in);
+
+  struct Segment segment;
+  init_segment(&segment);
+
+  int ret = write_binary_header(fd_out);
+
+  // Compile one segment at a time so memory stays bounded by the largest segment
+  do {
+    if (ret == 0 && parse_segment(reader, &segment) != 0) {
+      fprintf(stderr, "Failed to parse %s\n", argv[1]);
+      ret = 1;
+    }
+
+    if (ret == 0 && write_binary_segment(fd_out, &segment) != 0) {
+      fprintf(stderr, "Failed to write %s\n", out_path);
+      ret = 1;
+    }
+  } while (ret == 0 && segment.end == CMD_BARRIER);
+
+  free_segment(&segment);
+  free(reader);
+
+  close(fd_in);
+  close(fd_out);
+
+  return ret;
+}
@@ -1,2 +1,24 @@
-#define MAX_RESERVATION_SIZE 256
-#define STATE_ACCESS_DELAY_MS 10
\ No newline at end of file
+#define MAX_RESERVATION_SIZE 4096
+#define STATE_ACCESS_DELAY_MS 10
+#define READ_BUFFER_SIZE 65536
+
+// 1 to claim seats with compare-and-swap on their reservation ID, 0 to lock each seat with a mutex
+#define LOCK_FREE_RESERVE 1
+
+// Number of seat locks of an event for the seat lock engine, rows share them round-robin (at most 64)
+#define SEAT_LOCK_STRIPES 64
+
+// Number of output blocks that can wait for the writer thread of a file
+#define OUTPUT_QUEUE_SIZE 256
+
+// Number of jobs files the single process pool (-w) keeps open for each of its threads
+#define POOL_FILES_PER_THREAD 2
+
+// Number of commands that can wait in a queue of the sharded or streaming modes (a power of two)
+#define TASK_QUEUE_SIZE 1024
+
+// Number of event handles each thread keeps in its cache of looked up events (a power of two)
+#define EVENT_CACHE_SIZE 64
+
+// Reservations of an event between the snapshots of its seats printed by SHOW, 0 to copy the seats on every SHOW
+#define SNAPSHOT_INTERVAL 0
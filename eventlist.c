@@ -3,21 +3,76 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#define INITIAL_INDEX_CAPACITY 64
+
+/// Hashes an event ID into a slot of the index.
+/// @param event_id Event ID.
+/// @param capacity Number of slots of the index, a power of two.
+/// @return Slot where the search for the event starts.
+static size_t hash_slot(unsigned int event_id, size_t capacity) {
+  unsigned int h = event_id;
+  h ^= h >> 16;
+  h *= 0x45d9f3bU;
+  h ^= h >> 16;
+  h *= 0x45d9f3bU;
+  h ^= h >> 16;
+  return (size_t)h & (capacity - 1);
+}
+
+/// Places an event in the first free slot of its probe sequence.
+/// @note The index must have at least one free slot.
+static void index_event(struct Event** index, size_t capacity, struct Event* event) {
+  size_t slot = hash_slot(event->id, capacity);
+  while (index[slot] != NULL) {
+    slot = (slot + 1) & (capacity - 1);
+  }
+  index[slot] = event;
+}
+
+/// Doubles the number of slots of the index, rehashing every event.
+/// @return 0 if the index was grown successfully, 1 otherwise.
+static int grow_index(struct EventList* list) {
+  size_t capacity = list->index_capacity * 2;
+  struct Event** index = (struct Event**)calloc(capacity, sizeof(struct Event*));
+  if (!index) return 1;
+
+  for (size_t i = 0; i < list->index_capacity; i++) {
+    if (list->index[i] != NULL) {
+      index_event(index, capacity, list->index[i]);
+    }
+  }
+
+  free(list->index);
+  list->index = index;
+  list->index_capacity = capacity;
+  return 0;
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
-  if(pthread_mutex_init(&list->event_list_lock, NULL) != 0){
-    fprintf(stderr, "Failed to initialize mutex\n");
+  if(pthread_rwlock_init(&list->event_list_lock, NULL) != 0){
+    fprintf(stderr, "Failed to initialize rwlock\n");
     exit(1);
   }
   list->head = NULL;
   list->tail = NULL;
+  list->size = 0;
+  list->index_capacity = INITIAL_INDEX_CAPACITY;
+  list->index = (struct Event**)calloc(INITIAL_INDEX_CAPACITY, sizeof(struct Event*));
+  if (!list->index) {
+    free(list);
+    return NULL;
+  }
   return list;
 }
 
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
+  // Keep the load factor of the index at most 1/2
+  if ((list->size + 1) * 2 > list->index_capacity && grow_index(list) != 0) return 1;
+
   struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
   if (!new_node) return 1;
 
@@ -32,15 +87,31 @@ int append_to_list(struct EventList* list, struct Event* event) {
     list->tail = new_node;
   }
 
+  index_event(list->index, list->index_capacity, event);
+  list->size++;
+
   return 0;
 }
 
-static void free_event(struct Event* event) {
+void free_event(struct Event* event) {
   if (!event) return;
-  if(pthread_mutex_destroy(&event->event_lock) != 0){
+#if !LOCK_FREE_RESERVE
+  for (size_t i = 0; i < event->num_seat_locks; i++) {
+    if(pthread_mutex_destroy(&event->seat_locks[i]) != 0){
+      fprintf(stderr, "Failed to destroy mutex\n");
+      exit(1);
+    }
+  }
+  free(event->seat_locks);
+#endif
+  if(pthread_mutex_destroy(&event->snapshot_lock) != 0){
     fprintf(stderr, "Failed to destroy mutex\n");
     exit(1);
   }
+  free(event->published);
+  free(event->row_free);
+  free(event->row_run);
+  free(event->occupied);
   free(event->data);
   free(event);
 }
@@ -56,23 +127,23 @@ void free_list(struct EventList* list) {
     free_event(temp->event);
     free(temp);
   }
-  if(pthread_mutex_destroy(&list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to destroy mutex\n");
+  if(pthread_rwlock_destroy(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to destroy rwlock\n");
     exit(1);
   }
+  free(list->index);
   free(list);
 }
 
 struct Event* get_event(struct EventList* list, unsigned int event_id) {
   if (!list) return NULL;
 
-  struct ListNode* current = list->head;
-  while (current) {
-    struct Event* event = current->event;
-    if (event->id == event_id) {
-      return event;
+  size_t slot = hash_slot(event_id, list->index_capacity);
+  while (list->index[slot] != NULL) {
+    if (list->index[slot]->id == event_id) {
+      return list->index[slot];
     }
-    current = current->next;
+    slot = (slot + 1) & (list->index_capacity - 1);
   }
 
   return NULL;
@@ -3,23 +3,47 @@
 
 #include <stddef.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <stdint.h>
 
-struct Seat {
-  unsigned int reservation_id;  /// Seat reservation ID
+#include "bitmap.h"
+#include "constants.h"
 
-  pthread_mutex_t seat_lock;
+#define SEAT_PENDING UINT_MAX  /// Reservation ID of a seat claimed by a reservation in progress
+
+// Immutable copy of the seats of an event, shared by the SHOWs reading it
+struct SeatSnapshot {
+  atomic_uint refs;      /// SHOWs reading the snapshot, plus one while it is the published one.
+  uint64_t version;      /// Version of the event the seats were copied at.
+  unsigned int seats[];  /// Reservation ID of each seat.
 };
 
 struct Event {
   unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  size_t sequence;            /// Order the event was created in across every shard, 0 outside of sharded mode.
+  atomic_uint reservations;   /// Number of reservations for the event.
+  _Atomic uint64_t version;   /// Commits of reservations in the high half, reservations committing in the low half.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  struct Seat* data;  /// Array of size rows * cols with the reservations for each seat.
+  atomic_uint* data;  /// Array of size rows * cols with the reservation ID of each seat.
+
+  bitmap_word_t* occupied;  /// Bitmap with a bit set for each seat of a committed reservation.
+
+  atomic_size_t reserved;  /// Number of seats of committed reservations.
+  atomic_size_t* row_free; /// Number of free seats of each row.
+  atomic_size_t* row_run;  /// Longest run of free seats of each row.
 
-  pthread_mutex_t event_lock;
+  struct SeatSnapshot* published;  /// Latest snapshot of the seats, NULL unless snapshots are enabled.
+  pthread_mutex_t snapshot_lock;   /// Taken only to swap the published snapshot or take a reference to it.
+  atomic_uint unpublished;         /// Reservations committed since the last snapshot was published.
+
+#if !LOCK_FREE_RESERVE
+  pthread_mutex_t* seat_locks;  /// Striped seat locks, row r is guarded by seat_locks[(r - 1) % num_seat_locks].
+  size_t num_seat_locks;        /// Number of seat locks, at most SEAT_LOCK_STRIPES.
+#endif
 };
 
 struct ListNode {
@@ -27,19 +51,23 @@ struct ListNode {
   struct ListNode* next;
 };
 
-// Linked list structure
+// Linked list structure, indexed by a hash table on the event IDs
 struct EventList {
   struct ListNode* head;  // Head of the list
   struct ListNode* tail;  // Tail of the list
 
-  pthread_mutex_t event_list_lock;
+  struct Event** index;   // Open addressing hash table with linear probing, NULL on empty slots
+  size_t index_capacity;  // Number of slots of the hash table, always a power of two
+  size_t size;            // Number of events in the list
+
+  pthread_rwlock_t event_list_lock;  // Taken for writing only to add events
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Appends a new node to the list and indexes its event.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
@@ -50,7 +78,11 @@ int append_to_list(struct EventList* list, struct Event* data);
 /// @return 0 if the node was removed successfully, 1 otherwise.
 void free_list(struct EventList* list);
 
-/// Retrieves an event in the list.
+/// Frees an event and its seats.
+/// @param event Event to be freed.
+void free_event(struct Event* event);
+
+/// Retrieves an event in the list through the hash index.
 /// @param list Event list to be searched
 /// @param event_id Event id.
 /// @return Pointer to the event if found, NULL otherwise.
@@ -1,13 +1,15 @@
 #include "filehandler.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 
 int open_file(char *dir_path, char *file_name, int *fd_jobs, int *fd_out){
   // .jobs file path = directory path + name of file
-  size_t path_len = strlen(dir_path) + strlen(file_name) + 1;
+  size_t path_len = strlen(dir_path) + strlen(file_name) + strlen(".out") + 1;
   char file_path[path_len];
 
   strcpy(file_path, dir_path);
@@ -18,8 +20,8 @@ int open_file(char *dir_path, char *file_name, int *fd_jobs, int *fd_out){
     return -1;
   }  
 
-  // .out file path = .jobs file path - ".jobs" + ".out"
-  file_path[path_len - 6] = '\0';
+  // .out file path = .jobs file path - extension + ".out"
+  *strrchr(file_path, '.') = '\0';
   strcat(file_path, ".out");
 
   *fd_out = open(file_path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
@@ -30,14 +32,36 @@ int open_file(char *dir_path, char *file_name, int *fd_jobs, int *fd_out){
   return 0;
 }
 
+/// Checks if a file name ends with the given extension.
+static int has_extension(const char *file_name, const char *extension){
+  size_t name_len = strlen(file_name);
+  size_t extension_len = strlen(extension);
+
+  return name_len > extension_len && strcmp(file_name + name_len - extension_len, extension) == 0;
+}
+
+enum JobsFormat jobs_format(const char *file_name){
+  if(has_extension(file_name, JOBS_EXTENSION)){
+    return TEXT_JOBS;
+  }
+  if(has_extension(file_name, BINARY_JOBS_EXTENSION)){
+    return BINARY_JOBS;
+  }
+  return NOT_JOBS;
+}
+
 int write_to_file(int fd, char *buffer){ 
-  size_t len = strlen(buffer);
+  return write_buffer(fd, buffer, strlen(buffer));
+}
+
+int write_buffer(int fd, const char *buffer, size_t len){
   long int done = 0;
   
   while(len > 0){
     long int bytes_written = write(fd, buffer + done, len);
 
     if(bytes_written < 0){
+      if(errno == EINTR) continue;
       return 1;
     }
 
@@ -46,4 +70,88 @@ int write_to_file(int fd, char *buffer){
   }
 
   return 0;
-}
\ No newline at end of file
+}
+
+int reserve_output(struct OutputBuffer *buffer, size_t n){
+  if(buffer->capacity - buffer->len >= n){
+    return 0;
+  }
+
+  size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+  while(capacity - buffer->len < n){
+    capacity *= 2;
+  }
+
+  char *data = realloc(buffer->data, capacity);
+  if(data == NULL){
+    return 1;
+  }
+
+  buffer->data = data;
+  buffer->capacity = capacity;
+
+  return 0;
+}
+
+void init_reader(struct FileReader *reader, int fd){
+  reader->fd = fd;
+  reader->pos = 0;
+  reader->len = 0;
+}
+
+/// Refills the reader buffer with the next chunk of the file.
+/// @param reader Reader to be refilled
+/// @return Number of bytes now available, 0 at the end of the file or on error
+static size_t refill(struct FileReader *reader){
+  long int bytes_read;
+
+  do {
+    bytes_read = read(reader->fd, reader->buffer, READ_BUFFER_SIZE);
+  } while(bytes_read < 0 && errno == EINTR);
+
+  reader->pos = 0;
+  reader->len = bytes_read > 0 ? (size_t)bytes_read : 0;
+
+  return reader->len;
+}
+
+int read_char(struct FileReader *reader, char *ch){
+  if(reader->pos == reader->len && refill(reader) == 0){
+    return 0;
+  }
+
+  *ch = reader->buffer[reader->pos++];
+  return 1;
+}
+
+size_t peek_chars(struct FileReader *reader, const char **data){
+  if(reader->pos == reader->len){
+    refill(reader);
+  }
+
+  *data = reader->buffer + reader->pos;
+  return reader->len - reader->pos;
+}
+
+void skip_chars(struct FileReader *reader, size_t n){
+  reader->pos += n;
+}
+
+size_t read_chars(struct FileReader *reader, char *buf, size_t n){
+  size_t done = 0;
+
+  while(done < n){
+    if(reader->pos == reader->len && refill(reader) == 0){
+      break;
+    }
+
+    size_t available = reader->len - reader->pos;
+    size_t chunk = n - done < available ? n - done : available;
+
+    memcpy(buf + done, reader->buffer + reader->pos, chunk);
+    reader->pos += chunk;
+    done += chunk;
+  }
+
+  return done;
+}
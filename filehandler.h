@@ -3,8 +3,36 @@
 
 #include <stddef.h>
 
-/// Opens the .jobs with the given name in the given directory and creates a .out
-/// file with the same name.
+#include "constants.h"
+
+#define JOBS_EXTENSION ".jobs"
+#define BINARY_JOBS_EXTENSION ".bjobs"
+
+// Format of a file in the jobs directory
+enum JobsFormat {
+  NOT_JOBS,     // Not a jobs file
+  TEXT_JOBS,    // Textual .jobs file
+  BINARY_JOBS   // Compiled .bjobs file
+};
+
+// Growable buffer where output is rendered before being written
+struct OutputBuffer {
+  char *data;       // Rendered output
+  size_t len;       // Number of bytes rendered
+  size_t capacity;  // Allocated size of data
+};
+
+// Buffered reader over a file descriptor
+struct FileReader {
+  int fd;        // File descriptor being read
+  size_t pos;    // Position of the next unread byte in the buffer
+  size_t len;    // Number of valid bytes in the buffer
+
+  char buffer[READ_BUFFER_SIZE];
+};
+
+/// Opens the .jobs (or .bjobs) with the given name in the given directory and
+/// creates a .out file with the same name.
 /// @param dir_path Path for the jobs directory
 /// @param file_name Name of the file inside of the jobs directory
 /// @param fd_jobs Pointer for the file descriptor of the .jobs file
@@ -12,10 +40,58 @@
 /// @return 0 if both files were successfuly opened and -1 if any error occured
 int open_file(char *dir_path, char *file_name, int *fd_jobs, int *fd_out);
 
+/// Tells the format of a file in the jobs directory from its extension
+/// @param file_name Name of the file
+/// @return Format of the file, NOT_JOBS if it isn't a jobs file
+enum JobsFormat jobs_format(const char *file_name);
+
 /// Writes what's in the buffer to the file that has the given file descriptor
 /// @param fd File descriptor of the file we want to write
 /// @param buffer buffer with the content to be written to the file
 /// @return 0 if content was successfuly writen and 1 otherwise
 int write_to_file(int fd, char *buffer);
 
+/// Writes len bytes of the buffer to the file that has the given file descriptor
+/// @param fd File descriptor of the file we want to write
+/// @param buffer buffer with the content to be written to the file
+/// @param len number of bytes to write
+/// @return 0 if content was successfuly writen and 1 otherwise
+int write_buffer(int fd, const char *buffer, size_t len);
+
+/// Makes sure an output buffer has room for n more bytes, growing it if needed
+/// @param buffer Buffer to be grown
+/// @param n Number of bytes needed after the current contents
+/// @return 0 if there is enough space and 1 if memory ran out
+int reserve_output(struct OutputBuffer *buffer, size_t n);
+
+/// Initializes a buffered reader for the given file descriptor
+/// @param reader Reader to be initialized
+/// @param fd File descriptor to read from
+void init_reader(struct FileReader *reader, int fd);
+
+/// Reads the next character, refilling the buffer from the file when it runs out
+/// @param reader Reader to read from
+/// @param ch Pointer to the variable to store the character in
+/// @return 1 if a character was read and 0 at the end of the file or on error
+int read_char(struct FileReader *reader, char *ch);
+
+/// Gives direct access to the unread characters in the buffer, refilling it
+/// first if it is empty
+/// @param reader Reader to peek into
+/// @param data Pointer to store the address of the first unread character in
+/// @return Number of characters available at data, 0 at the end of the file
+size_t peek_chars(struct FileReader *reader, const char **data);
+
+/// Consumes characters previously returned by peek_chars
+/// @param reader Reader to advance
+/// @param n Number of characters to consume, at most the number available
+void skip_chars(struct FileReader *reader, size_t n);
+
+/// Reads up to n characters, refilling the buffer as many times as needed
+/// @param reader Reader to read from
+/// @param buf Buffer to store the characters in
+/// @param n Number of characters to read
+/// @return Number of characters read, less than n only at the end of the file or on error
+size_t read_chars(struct FileReader *reader, char *buf, size_t n);
+
 #endif  // EMS_FILEHANDLER_H
@@ -7,308 +7,1633 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
 #include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 #include "constants.h"
 #include "operations.h"
 #include "parser.h"
 #include "filehandler.h"
+#include "segment.h"
+#include "binjobs.h"
+#include "writer.h"
+#include "queue.h"
+#include "timer.h"
 
 #define FALSE (0)
 #define TRUE (1)
 
+// How the commands of the jobs files are spread over the threads
+enum ExecutionMode {
+  SEGMENT_MODE,    // threads claim the commands of each segment, parsed ahead by the main thread
+  SHARDED_MODE,    // each thread owns the events hashed to it (-s)
+  STREAMING_MODE,  // commands are streamed to the threads as they are parsed (-p)
+  POOL_MODE        // one process runs every file on a single pool of threads (-w)
+};
+
 
 typedef struct {
   int fd_jobs;              // file descriptor for the .jobs file
+  enum JobsFormat format;   // format of the jobs file
+  struct FileReader reader; // buffered reader of a .jobs file
+  struct BinaryReader binary; // mapped contents of a .bjobs file
   int fd_out;               // file descriptor for the .out file
-  unsigned int *wait;       // pointer to array with the delays of each thread
-  unsigned int barrier;     // indicates if a barrier was found by a thread
+  struct OutputWriter writer; // thread writing the output of SHOW and LIST to the .out file
+  uint64_t *wait;           // pointer to array with the time each thread is delayed until
+  struct TimerQueue timers; // commands of the segment deferred by a WAIT
+  struct Segment segments[2]; // segment being executed and the next one, parsed meanwhile
+  struct Segment *segment;  // segment being executed
+  atomic_size_t next;       // index of the next unit of the stage to be executed
+  size_t stage_end;         // index after the last unit of the stage being executed
+  pthread_barrier_t barrier; // synchronizes the threads with the start and end of each segment
+  int finished;             // TRUE once the file has no more segments
+  enum ExecutionMode mode;  // how commands are spread over the threads
+  struct EventList **shards; // events owned by each thread in sharded mode
+  struct SpscQueue *queues; // commands routed to each thread in sharded mode
+  size_t next_sequence;     // sequence number of the next CREATE routed in sharded mode
+  struct MpmcQueue *stream; // commands parsed but not yet taken by a thread in streaming mode
   unsigned int MAX_THREADS; // max number of threads of each process
+  int cache_stats;          // TRUE to print the hits and misses of the event caches (-c)
 } thread_args;
 
-thread_args t_args;
+thread_args t_args;
+
+
+pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/// Takes what is left of the delay a WAIT has set for the thread, if any. The
+/// delay runs from the WAIT on, so a thread that was idle meanwhile owes less.
+/// @param wait Time each thread is delayed until for the file being run
+/// @param id ID of the thread, starting at 1
+/// @return Delay in milliseconds, 0 if the thread isn't delayed
+static unsigned int take_delay(uint64_t *wait, unsigned int id){
+  if(pthread_mutex_lock(&wait_lock) != 0){
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  uint64_t until = wait[id - 1];
+  wait[id - 1] = 0;
+
+  if(pthread_mutex_unlock(&wait_lock) != 0){
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  uint64_t now = now_ns();
+
+  // Round up, so the thread never wakes before the delay has passed
+  return until > now ? (unsigned int)((until - now + 999999) / 1000000) : 0;
+}
+
+/// Sleeps if a WAIT has set a delay for the thread.
+/// @param wait Time each thread is delayed until for the file being run
+/// @param id ID of the thread, starting at 1
+static void check_wait(uint64_t *wait, unsigned int id){
+  unsigned int thread_delay = take_delay(wait, id);
+
+  // Check if thread needs to wait
+  if(thread_delay != 0){
+    fprintf(stdout, "Waiting...\n");
+    ems_wait(thread_delay);
+  }
+}
+
+/// Executes one command.
+/// @param instruction Command to be executed
+/// @param xs Rows of the seats of a RESERVE
+/// @param ys Columns of the seats of a RESERVE
+/// @param out Writer of the output file
+/// @param wait Time each thread is delayed until for the file being run
+static void execute_instruction(struct Instruction *instruction, size_t *xs, size_t *ys, struct OutputWriter *out,
+                                uint64_t *wait){
+  switch (instruction->cmd) {
+    case CMD_CREATE:
+      if (ems_create(instruction->event_id, instruction->arg1, instruction->arg2)) {
+        fprintf(stderr, "Failed to create event\n");
+      }
+
+      break;
+
+    case CMD_RESERVE:
+      if (ems_reserve(instruction->event_id, instruction->num_coords, xs, ys)) {
+        fprintf(stderr, "Failed to reserve seats\n");
+      }
+
+      break;
+
+    case CMD_SHOW:
+      if (ems_show(instruction->event_id, out)) {
+        fprintf(stderr, "Failed to show event\n");
+      }
+
+      break;
+
+    case CMD_STATS:
+      if (ems_stats(instruction->event_id, out)) {
+        fprintf(stderr, "Failed to show event stats\n");
+      }
+
+      break;
+
+    case CMD_LIST_EVENTS:
+      if (ems_list_events(out)) {
+        fprintf(stderr, "Failed to list events\n");
+      }
+
+      break;
+
+    case CMD_WAIT:
+      if(instruction->arg2 > t_args.MAX_THREADS){
+        fprintf(stderr, "Invalid thread_id\n");
+        break;
+      }
+
+      if(instruction->arg1 > 0){
+        uint64_t until = now_ns() + (uint64_t)instruction->arg1 * 1000000;
+
+        if(pthread_mutex_lock(&wait_lock) != 0){
+          fprintf(stderr, "Failed to lock mutex\n");
+          exit(1);
+        }
+
+        // Set delay for all threads
+        if(instruction->arg2 == ALL_THREADS){
+          for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+            wait[i] = until;
+          }
+        }
+        // Set delay for the indicated thread
+        else{
+          wait[instruction->arg2 - 1] = until;
+        }
+
+        if(pthread_mutex_unlock(&wait_lock) != 0){
+          fprintf(stderr, "Failed to unlock mutex\n");
+          exit(1);
+        }
+      }
+
+      break;
+
+    case CMD_INVALID:
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      
+      break;
+
+    case CMD_HELP:
+      printf(
+          "Available commands:\n"
+          "  CREATE <event_id> <num_rows> <num_columns>\n"
+          "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+          "  SHOW <event_id>\n"
+          "  STATS <event_id>\n"
+          "  LIST\n"
+          "  WAIT <delay_ms> [thread_id]\n"
+          "  BARRIER\n"
+          "  HELP\n");
+      
+      break;
+
+    // Never stored in a segment
+    case CMD_BARRIER:
+    case CMD_EMPTY:
+    case EOC:
+      break;
+  }
+}
+
+/// Gets the number of units threads claim from a segment: its chains when it
+/// was scheduled, or the whole segment in file order otherwise.
+/// @param segment Segment to be claimed from
+/// @return Number of units
+static size_t count_units(struct Segment *segment){
+  if(segment->num_chains > 0){
+    return segment->num_chains;
+  }
+
+  return segment->num_instructions > 0 ? 1 : 0;
+}
+
+/// Gets the number of stages of a segment, which run one after the other.
+/// @param segment Segment to be run
+/// @return Number of stages, 1 if the segment wasn't split into any
+static size_t count_stages(struct Segment *segment){
+  return segment->num_stages > 0 ? segment->num_stages : 1;
+}
+
+/// Gets the units of a stage of a segment.
+/// @param segment Segment the stage belongs to
+/// @param stage Index of the stage
+/// @param first Where to store the index of its first unit
+/// @param end Where to store the index after its last unit
+static void stage_units(struct Segment *segment, size_t stage, size_t *first, size_t *end){
+  if(segment->num_stages == 0){
+    *first = 0;
+    *end = count_units(segment);
+    return;
+  }
+
+  *first = stage > 0 ? segment->stage_ends[stage - 1] : 0;
+  *end = segment->stage_ends[stage];
+}
+
+/// Gets the positions of the commands of a unit of a segment.
+/// @param segment Segment the unit belongs to
+/// @param unit Index of the unit
+/// @param first Where to store the position of its first command
+/// @param last Where to store the position after its last command
+static void unit_bounds(struct Segment *segment, size_t unit, size_t *first, size_t *last){
+  if(segment->num_chains > 0){
+    *first = segment->chain_starts[unit];
+    *last = segment->chain_starts[unit + 1];
+  }
+  else{
+    *first = 0;
+    *last = segment->num_instructions;
+  }
+}
+
+/// Runs the commands of a unit of a segment from a position on. When a WAIT
+/// has delayed the thread, the rest of the unit is deferred on a timer instead
+/// of sleeping, so the thread can move on to other work meanwhile. A resumed
+/// unit has already waited, so the delay of the thread resuming it is left for
+/// its next unit, unless a WAIT inside of the unit sets a new one.
+/// @param segment Segment the unit belongs to
+/// @param unit Index of the unit
+/// @param pos Position of the first command to run
+/// @param resumed TRUE if the unit is resumed after being deferred
+/// @param id ID of the thread, starting at 1
+/// @param out Writer of the output file
+/// @param wait Time each thread is delayed until for the file being run
+/// @param timers Commands of the file deferred by a WAIT
+/// @return TRUE if the unit was finished, FALSE if the rest of it was deferred
+static int run_unit(struct Segment *segment, size_t unit, size_t pos, int resumed, unsigned int id,
+                    struct OutputWriter *out, uint64_t *wait, struct TimerQueue *timers){
+  size_t first, last;
+  unit_bounds(segment, unit, &first, &last);
+
+  for(; pos < last; pos++){
+    unsigned int thread_delay = resumed == TRUE ? 0 : take_delay(wait, id);
+
+    if(thread_delay != 0){
+      fprintf(stdout, "Waiting...\n");
+
+      if(add_timer(timers, thread_delay, unit, pos) == 0){
+        return FALSE;
+      }
+
+      // Out of memory for the timer, so sleep through the delay instead
+      ems_wait(thread_delay);
+    }
+
+    struct Instruction *instruction = &segment->instructions[segment->num_chains > 0 ? segment->order[pos] : pos];
+    execute_instruction(instruction, segment->xs + instruction->coords, segment->ys + instruction->coords, out, wait);
+
+    if(instruction->cmd == CMD_WAIT){
+      resumed = FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/// Executes commands of the current stage of the segment until every one has
+/// run. Threads claim whole chains when the segment was scheduled, so commands
+/// on the same event run in file order on one thread, and the whole segment
+/// otherwise. Commands deferred by a WAIT are resumed by whichever thread finds
+/// their delay passed, before claiming anything new.
+/// @param id ID of the thread, starting at 1
+static void execute_segment(unsigned int id){
+  struct Segment *segment = t_args.segment;
+  size_t units = t_args.stage_end;
+  struct Timer timer;
+
+  while(1){
+    if(take_expired_timer(&t_args.timers, &timer)){
+      run_unit(segment, timer.unit, timer.pos, TRUE, id, &t_args.writer, t_args.wait, &t_args.timers);
+      continue;
+    }
+
+    // Claim the next unit of the stage
+    size_t index = atomic_fetch_add(&t_args.next, 1);
+
+    if(index < units){
+      size_t first, last;
+      unit_bounds(segment, index, &first, &last);
+      run_unit(segment, index, first, FALSE, id, &t_args.writer, t_args.wait, &t_args.timers);
+      continue;
+    }
+
+    // Nothing left to claim, so only deferred commands remain
+    if(wait_timer(&t_args.timers, &timer) == 0){
+      return;
+    }
+
+    run_unit(segment, timer.unit, timer.pos, TRUE, id, &t_args.writer, t_args.wait, &t_args.timers);
+  }
+}
+
+/// Gets the thread that owns an event in sharded mode.
+/// @param event_id ID of the event
+/// @return Index of the owner thread, starting at 0
+static unsigned int shard_of(unsigned int event_id){
+  return (unsigned int)(((uint64_t)(event_id * 2654435769U) * t_args.MAX_THREADS) >> 32);
+}
+
+/// Hands every command of a segment to the threads in sharded mode, followed by
+/// the end of the segment. Commands on an event go to its owner, LIST goes to
+/// every thread and WAIT to the threads it delays.
+/// @param segment Segment to be routed
+static void route_segment(struct Segment *segment){
+  for(size_t i = 0; i < segment->num_instructions; i++){
+    struct Instruction *instruction = &segment->instructions[i];
+
+    switch (instruction->cmd) {
+      case CMD_RESERVE:
+      case CMD_SHOW:
+      case CMD_STATS:
+        spsc_push(&t_args.queues[shard_of(instruction->event_id)], (struct Task){instruction, NULL, 0});
+        break;
+
+      // LIST merges the shards by the order their events were created in
+      case CMD_CREATE:
+        spsc_push(&t_args.queues[shard_of(instruction->event_id)],
+                  (struct Task){instruction, NULL, t_args.next_sequence++});
+        break;
+
+      case CMD_LIST_EVENTS: {
+        struct ListGather *gather = ems_create_gather(t_args.MAX_THREADS);
+
+        if(gather == NULL){
+          fprintf(stderr, "Failed to list events\n");
+          break;
+        }
+
+        for(unsigned int t = 0; t < t_args.MAX_THREADS; t++){
+          spsc_push(&t_args.queues[t], (struct Task){instruction, gather, 0});
+        }
+
+        break;
+      }
+
+      case CMD_WAIT:
+        if(instruction->arg2 > t_args.MAX_THREADS){
+          fprintf(stderr, "Invalid thread_id\n");
+          break;
+        }
+
+        if(instruction->arg1 == 0){
+          break;
+        }
+
+        for(unsigned int t = 0; t < t_args.MAX_THREADS; t++){
+          if(instruction->arg2 == ALL_THREADS || instruction->arg2 == t + 1){
+            spsc_push(&t_args.queues[t], (struct Task){instruction, NULL, 0});
+          }
+        }
+
+        break;
+
+      case CMD_INVALID:
+      case CMD_HELP:
+        spsc_push(&t_args.queues[i % t_args.MAX_THREADS], (struct Task){instruction, NULL, 0});
+        break;
+
+      // Never stored in a segment
+      case CMD_BARRIER:
+      case CMD_EMPTY:
+      case EOC:
+        break;
+    }
+  }
+
+  for(unsigned int t = 0; t < t_args.MAX_THREADS; t++){
+    spsc_push(&t_args.queues[t], (struct Task){NULL, NULL, 0});
+  }
+}
+
+/// Executes the commands routed to a thread in sharded mode until the end of the segment.
+/// @param id ID of the thread, starting at 1
+static void execute_shard(unsigned int id){
+  struct EventList *shard = t_args.shards[id - 1];
+
+  while(1){
+    struct Task task = spsc_pop(&t_args.queues[id - 1]);
+    struct Instruction *instruction = task.instruction;
+
+    if(instruction == NULL){
+      return;
+    }
+
+    switch (instruction->cmd) {
+      case CMD_CREATE:
+        if (ems_shard_create(shard, instruction->event_id, instruction->arg1, instruction->arg2, task.sequence)) {
+          fprintf(stderr, "Failed to create event\n");
+        }
+
+        break;
+
+      case CMD_RESERVE:
+        if (ems_shard_reserve(shard, instruction->event_id, instruction->num_coords,
+                              t_args.segment->xs + instruction->coords, t_args.segment->ys + instruction->coords)) {
+          fprintf(stderr, "Failed to reserve seats\n");
+        }
+
+        break;
+
+      case CMD_SHOW:
+        if (ems_shard_show(shard, instruction->event_id, &t_args.writer)) {
+          fprintf(stderr, "Failed to show event\n");
+        }
+
+        break;
+
+      case CMD_STATS:
+        if (ems_shard_stats(shard, instruction->event_id, &t_args.writer)) {
+          fprintf(stderr, "Failed to show event stats\n");
+        }
+
+        break;
+
+      case CMD_LIST_EVENTS:
+        if (ems_shard_list_events(shard, id - 1, (struct ListGather *)task.context, &t_args.writer)) {
+          fprintf(stderr, "Failed to list events\n");
+        }
+
+        break;
+
+      // Only routed to the threads it delays
+      case CMD_WAIT:
+        fprintf(stdout, "Waiting...\n");
+        ems_wait(instruction->arg1);
+
+        break;
+
+      case CMD_INVALID:
+      case CMD_HELP:
+        execute_instruction(instruction, NULL, NULL, &t_args.writer, t_args.wait);
+
+        break;
+
+      case CMD_BARRIER:
+      case CMD_EMPTY:
+      case EOC:
+        break;
+    }
+  }
+}
+
+/// Waits on the barrier shared by the threads and the main thread of the process.
+static void wait_barrier(){
+  int ret = pthread_barrier_wait(&t_args.barrier);
+
+  if(ret != 0 && ret != PTHREAD_BARRIER_SERIAL_THREAD){
+    fprintf(stderr, "Failed to wait on barrier\n");
+    exit(1);
+  }
+}
+
+void *execute_commands(void *arg){
+  unsigned int id = *(unsigned int *)arg; // Thread ID
+
+  // Threads live for the whole file, executing one segment between each pair of barrier waits
+  while(1){
+    wait_barrier();
+
+    if(t_args.finished == TRUE){
+      return NULL;
+    }
+
+    if(t_args.mode == SHARDED_MODE){
+      execute_shard(id);
+    }
+    else{
+      execute_segment(id);
+    }
+
+    wait_barrier();
+  }
+}
+
+/// Reads the next segment of the jobs file.
+/// @param segment Segment to store the commands in
+static void read_segment(struct Segment *segment){
+  int parse_ret = t_args.format == BINARY_JOBS ? load_binary_segment(&t_args.binary, segment)
+                                               : parse_segment(&t_args.reader, segment);
+
+  if(parse_ret != 0){
+    fprintf(stderr, "Failed to parse file.\n");
+    exit(1);
+  }
+
+  // With a single thread there is nothing to run in parallel, so keep file order
+  if(t_args.mode != SHARDED_MODE && t_args.MAX_THREADS > 1 && schedule_segment(segment) != 0){
+    fprintf(stderr, "Failed to schedule segment.\n");
+    exit(1);
+  }
+}
+
+
+/// Executes commands taken from the stream until the end of the file. Each
+/// BARRIER reaches every thread once, and they all wait for each other there.
+/// @param arg Pointer to the ID of the thread, starting at 1
+void *execute_stream(void *arg){
+  unsigned int id = *(unsigned int *)arg; // Thread ID
+
+  while(1){
+    check_wait(t_args.wait, id);
+
+    struct Message message = mpmc_pop(t_args.stream);
+    struct Instruction *instruction = &message.instruction;
+
+    if(instruction->cmd == EOC){
+      return NULL;
+    }
+
+    if(instruction->cmd == CMD_BARRIER){
+      wait_barrier(); // Every command before the barrier is done
+
+      if(pthread_mutex_lock(&wait_lock) != 0){
+        fprintf(stderr, "Failed to lock mutex\n");
+        exit(1);
+      }
+
+      t_args.wait[id - 1] = 0;
+
+      if(pthread_mutex_unlock(&wait_lock) != 0){
+        fprintf(stderr, "Failed to unlock mutex\n");
+        exit(1);
+      }
+
+      wait_barrier(); // No delay from before the barrier is left
+      continue;
+    }
+
+    execute_instruction(instruction, message.xs, message.ys, &t_args.writer, t_args.wait);
+    free(message.xs);
+  }
+}
+
+/// Parses the jobs file one command at a time, pushing each one to the stream
+/// as soon as it is decoded. BARRIER and the end of the file are sent once for
+/// every thread.
+static void stream_file(){
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+
+  while(1){
+    struct Message message = {.xs = NULL, .ys = NULL};
+    struct Instruction *instruction = &message.instruction;
+
+    if(t_args.format == BINARY_JOBS){
+      if(load_binary_instruction(&t_args.binary, instruction, xs, ys) != 0){
+        fprintf(stderr, "Failed to parse file.\n");
+        exit(1);
+      }
+    }
+    else{
+      parse_instruction(&t_args.reader, instruction, xs, ys);
+    }
+
+    if(instruction->cmd == CMD_BARRIER || instruction->cmd == EOC){
+      for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+        mpmc_push(t_args.stream, message);
+      }
+
+      if(instruction->cmd == EOC){
+        return;
+      }
+
+      continue;
+    }
+
+    // The seats of a RESERVE get their own copy, the parse buffers are reused
+    if(instruction->num_coords > 0){
+      message.xs = (size_t *)malloc(2 * instruction->num_coords * sizeof(size_t));
+
+      if(!message.xs){
+        fprintf(stderr, "Failed to parse file.\n");
+        exit(1);
+      }
+
+      message.ys = message.xs + instruction->num_coords;
+      memcpy(message.xs, xs, instruction->num_coords * sizeof(size_t));
+      memcpy(message.ys, ys, instruction->num_coords * sizeof(size_t));
+    }
+
+    mpmc_push(t_args.stream, message);
+  }
+}
+
+/// Runs the jobs file segment by segment on the threads, and each segment
+/// stage by stage, parsing each segment while the last stage of the previous
+/// one runs, and stops the threads at the end.
+static void run_segments(){
+  unsigned int current = 0;
+  read_segment(&t_args.segments[current]);
+
+  // Run each segment on the threads while the next one is parsed
+  while(1){
+    t_args.segment = &t_args.segments[current];
+
+    for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+      t_args.wait[i] = 0;
+    }
+
+    size_t num_stages = count_stages(t_args.segment);
+
+    for(size_t stage = 0; stage < num_stages; stage++){
+      size_t first;
+      stage_units(t_args.segment, stage, &first, &t_args.stage_end);
+      atomic_store(&t_args.next, first);
+
+      wait_barrier(); // Start of the stage
+
+      if(t_args.mode == SHARDED_MODE){
+        route_segment(t_args.segment);
+      }
+
+      if(stage + 1 == num_stages && t_args.segment->end == CMD_BARRIER){
+        read_segment(&t_args.segments[1 - current]);
+      }
+
+      wait_barrier(); // End of the stage
+    }
+
+    if(t_args.segment->end != CMD_BARRIER){
+      break;
+    }
+
+    current = 1 - current;
+  }
+
+  t_args.finished = TRUE;
+  wait_barrier();
+}
+
+/// Prints how many event lookups the event caches served since ems_init.
+/// @param name Name of the jobs file, or files, the lookups were made for
+static void print_cache_stats(const char *name){
+  size_t hits, misses;
+  ems_event_cache_stats(&hits, &misses);
+
+  fprintf(stdout, "Event cache of %s: %zu hits, %zu misses\n", name, hits, misses);
+}
+
+// A jobs file found in the directory
+struct JobEntry {
+  char *name;              // name of the file inside of the directory
+  enum JobsFormat format;  // format of the file
+  off_t size;              // size of the file, as an estimate of its cost
+};
+
+// A slot of the single process pool (-w), running its jobs files one after another
+struct PoolFile {
+  int fd_jobs;                 // file descriptor for the .jobs file
+  int fd_out;                  // file descriptor for the .out file
+  const char *name;            // name of the jobs file
+  enum JobsFormat format;      // format of the jobs file
+  struct FileReader reader;    // buffered reader of a .jobs file
+  struct BinaryReader binary;  // mapped contents of a .bjobs file
+  struct OutputWriter writer;  // thread writing the output of the file
+  struct EventList *state;     // EMS state of the file
+  uint64_t *wait;              // time each thread is delayed until for the file
+  struct TimerQueue timers;    // commands of the segment deferred by a WAIT
+  struct Segment segment;      // segment being executed
+  size_t stage;                // stage of the segment being executed
+  _Atomic uint64_t claim;      // number of units of the segment in the high half, next one to claim in the low half
+  atomic_size_t remaining;     // number of units of the segment that haven't finished
+  atomic_int finished;         // TRUE once no file is left for the slot to run
+};
+
+struct PoolFile *pool_files;  // slots of the pool, each running one file at a time
+size_t num_pool_files;        // number of slots of the pool
+
+struct JobEntry *pool_jobs;   // jobs files run by the pool
+size_t num_pool_jobs;         // number of jobs files run by the pool
+char *pool_dir;               // path of the directory of the jobs files
+atomic_size_t next_pool_job;  // next jobs file for a slot to open
+atomic_int pool_failed;       // TRUE once a jobs file was skipped
+
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;  // protects the waits on pool_change
+pthread_cond_t pool_change;                             // signaled when a pool file may have new work
+_Atomic uint64_t pool_changes;                          // number of times pool_change was signaled
+
+/// Wakes the threads of the pool waiting for work, after a file got units to
+/// claim, deferred a command or was closed.
+static void notify_pool(){
+  if(pthread_mutex_lock(&pool_lock) != 0){
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  atomic_fetch_add(&pool_changes, 1);
+  pthread_cond_broadcast(&pool_change);
+
+  if(pthread_mutex_unlock(&pool_lock) != 0){
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+}
+
+/// Waits until a pool file may have new work: until it is signaled, or until
+/// the earliest command deferred by a WAIT may run.
+/// @param seen Value of pool_changes before the thread last looked for work
+static void wait_pool(uint64_t seen){
+  if(pthread_mutex_lock(&pool_lock) != 0){
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  // Anything signaled since the thread looked for work may not have been seen
+  if(atomic_load(&pool_changes) == seen){
+    uint64_t earliest = UINT64_MAX;
+
+    for(size_t i = 0; i < num_pool_files; i++){
+      uint64_t deadline;
+
+      if(atomic_load(&pool_files[i].finished) == FALSE && next_deadline(&pool_files[i].timers, &deadline) &&
+         deadline < earliest){
+        earliest = deadline;
+      }
+    }
+
+    int ret;
+
+    if(earliest == UINT64_MAX){
+      ret = pthread_cond_wait(&pool_change, &pool_lock);
+    }
+    else{
+      struct timespec until = {(time_t)(earliest / 1000000000), (long)(earliest % 1000000000)};
+      ret = pthread_cond_timedwait(&pool_change, &pool_lock, &until);
+    }
+
+    if(ret != 0 && ret != ETIMEDOUT){
+      fprintf(stderr, "Failed to wait on condition\n");
+      exit(1);
+    }
+  }
+
+  if(pthread_mutex_unlock(&pool_lock) != 0){
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+}
+
+/// Opens a jobs file in a slot of the pool and starts its output writer.
+/// @param file Slot to open the file in
+/// @param job Jobs file to be opened
+/// @return 0 if the file was opened, 1 otherwise
+static int start_pool_file(struct PoolFile *file, struct JobEntry *job){
+  if(open_file(pool_dir, job->name, &file->fd_jobs, &file->fd_out) < 0){
+    fprintf(stderr, "Failed to open file.\n");
+    return 1;
+  }
+
+  file->name = job->name;
+  file->format = job->format;
+
+  if(file->format == BINARY_JOBS){
+    if(open_binary(&file->binary, file->fd_jobs) != 0){
+      fprintf(stderr, "Invalid binary jobs file.\n");
+      close(file->fd_jobs);
+      close(file->fd_out);
+      return 1;
+    }
+  }
+  else{
+    init_reader(&file->reader, file->fd_jobs);
+  }
+
+  file->state = ems_create_state();
+  file->wait = (uint64_t *)malloc(t_args.MAX_THREADS * sizeof(uint64_t));
+
+  if(!file->state || !file->wait || start_writer(&file->writer, file->fd_out) != 0){
+    fprintf(stderr, "Failed to start output writer\n");
+    ems_free_state(file->state);
+    free(file->wait);
+
+    if(file->format == BINARY_JOBS){
+      close_binary(&file->binary);
+    }
+
+    close(file->fd_jobs);
+    close(file->fd_out);
+    return 1;
+  }
+
+  init_segment(&file->segment);
+  file->segment.end = CMD_BARRIER; // Nothing parsed yet
+  file->stage = 0;
+
+  return 0;
+}
+
+/// Opens the next jobs file of the pool in a slot, skipping and reporting the
+/// ones that can't be run.
+/// @param file Slot to open the file in
+/// @return TRUE if a file was opened, FALSE if none is left
+static int open_pool_file(struct PoolFile *file){
+  size_t job;
+
+  while((job = atomic_fetch_add(&next_pool_job, 1)) < num_pool_jobs){
+    if(start_pool_file(file, &pool_jobs[job]) == 0){
+      return TRUE;
+    }
+
+    fprintf(stderr, "Skipped jobs file %s\n", pool_jobs[job].name);
+    atomic_store(&pool_failed, TRUE);
+  }
+
+  return FALSE;
+}
+
+/// Closes the file of a slot of the pool once all its commands have run.
+/// @param file Slot of the file to be closed
+static void close_pool_file(struct PoolFile *file){
+  if(stop_writer(&file->writer) != 0){
+    fprintf(stderr, "Failed to write output\n");
+  }
+
+  if(file->format == BINARY_JOBS){
+    close_binary(&file->binary);
+  }
+
+  close(file->fd_jobs);
+  close(file->fd_out);
+
+  free_segment(&file->segment);
+  free(file->wait);
+  ems_free_state(file->state);
+}
+
+/// Lets the threads claim the units of the current stage of a file.
+/// @param file File to be claimed from
+static void start_pool_stage(struct PoolFile *file){
+  size_t first, end;
+  stage_units(&file->segment, file->stage, &first, &end);
+
+  atomic_store(&file->remaining, end - first);
+  atomic_store_explicit(&file->claim, (uint64_t)end << 32 | first, memory_order_release);
+  notify_pool();
+}
+
+/// Moves a file on to the next stage of its segment, or parses segments until
+/// one has commands to run. A file with no more segments is closed, and the
+/// slot moves on to the next file left, if any.
+/// @note Only called while no command of the file is running
+/// @param file Slot of the file to be moved on
+static void advance_pool_file(struct PoolFile *file){
+  if(file->stage + 1 < count_stages(&file->segment)){
+    file->stage++;
+    start_pool_stage(file);
+    return;
+  }
+
+  while(1){
+    while(file->segment.end == CMD_BARRIER){
+      int parse_ret = file->format == BINARY_JOBS ? load_binary_segment(&file->binary, &file->segment)
+                                                  : parse_segment(&file->reader, &file->segment);
+
+      // The output so far is kept, and the slot moves on to the next file
+      if(parse_ret != 0 || (t_args.MAX_THREADS > 1 && schedule_segment(&file->segment) != 0)){
+        fprintf(stderr, "Failed to parse file.\n");
+        fprintf(stderr, "Stopped jobs file %s\n", file->name);
+        atomic_store(&pool_failed, TRUE);
+        break;
+      }
+
+      if(count_units(&file->segment) == 0){
+        continue;
+      }
+
+      for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+        file->wait[i] = 0;
+      }
+
+      file->stage = 0;
+      start_pool_stage(file);
+      return;
+    }
+
+    close_pool_file(file);
+
+    if(!open_pool_file(file)){
+      atomic_store(&file->finished, TRUE);
+      notify_pool();
+      return;
+    }
+  }
+}
+
+/// Finishes a unit of the current stage of a file. The thread finishing the
+/// last one of the stage moves the file on.
+/// @param file File the unit belongs to
+static void finish_pool_unit(struct PoolFile *file){
+  if(atomic_fetch_sub(&file->remaining, 1) == 1){
+    advance_pool_file(file);
+  }
+}
+
+/// Resumes a unit of the current segment of a file deferred by a WAIT, once its
+/// delay has passed.
+/// @param file File to resume from
+/// @param id ID of the thread, starting at 1
+/// @return TRUE if something was run, FALSE if no delay had passed
+static int resume_pool_unit(struct PoolFile *file, unsigned int id){
+  struct Timer timer;
+
+  if(!take_expired_timer(&file->timers, &timer)){
+    return FALSE;
+  }
+
+  ems_use_state(file->state);
+
+  if(run_unit(&file->segment, timer.unit, timer.pos, TRUE, id, &file->writer, file->wait, &file->timers)){
+    finish_pool_unit(file);
+  }
+  else{
+    notify_pool(); // Deferred again, maybe before what the waiting threads wake up for
+  }
+
+  return TRUE;
+}
+
+/// Claims one unit of the current stage of a file and runs it.
+/// @param file File to claim from
+/// @param id ID of the thread, starting at 1
+/// @return TRUE if something was run, FALSE if there was nothing left to claim
+static int run_pool_unit(struct PoolFile *file, unsigned int id){
+  uint64_t claim = atomic_load_explicit(&file->claim, memory_order_acquire);
+
+  do{
+    if((claim & UINT32_MAX) >= claim >> 32){
+      return FALSE;
+    }
+  } while(!atomic_compare_exchange_weak_explicit(&file->claim, &claim, claim + 1, memory_order_acq_rel,
+                                                 memory_order_acquire));
+
+  struct Segment *segment = &file->segment;
+  size_t index = (size_t)(claim & UINT32_MAX);
+  size_t first, last;
+  unit_bounds(segment, index, &first, &last);
+
+  ems_use_state(file->state);
+
+  if(run_unit(segment, index, first, FALSE, id, &file->writer, file->wait, &file->timers)){
+    finish_pool_unit(file);
+  }
+  else{
+    notify_pool(); // Deferred, maybe before what the waiting threads wake up for
+  }
+
+  return TRUE;
+}
+
+/// Runs commands of the pool files until all of them are finished. Each thread
+/// starts with a file of its own and steals from the others when that one has
+/// nothing left to claim. With nothing to run anywhere, it sleeps until a file
+/// changes or a deferred command may run.
+/// @param arg Pointer to the ID of the thread, starting at 1
+void *run_pool_worker(void *arg){
+  unsigned int id = *(unsigned int *)arg; // Thread ID
+  size_t home = (id - 1) % num_pool_files;
+
+  while(1){
+    uint64_t seen = atomic_load(&pool_changes);
+    int active = FALSE;
+    int ran = FALSE;
+
+    for(size_t k = 0; k < num_pool_files && ran == FALSE; k++){
+      struct PoolFile *file = &pool_files[(home + k) % num_pool_files];
+
+      if(atomic_load(&file->finished) == TRUE){
+        continue;
+      }
+
+      active = TRUE;
+      ran = resume_pool_unit(file, id) || run_pool_unit(file, id);
+    }
+
+    if(active == FALSE){
+      ems_use_state(NULL);
+      return NULL;
+    }
+
+    if(ran == FALSE){
+      wait_pool(seen);
+    }
+  }
+}
+
+/// Runs every jobs file of a directory in this process, on a single pool of
+/// threads, each file with its own EMS state and output. Only a few files per
+/// thread are open at a time, and files that can't be run are skipped.
+/// @param jobs Jobs files of the directory
+/// @param num_jobs Number of jobs files
+/// @param dir_path Path of the directory, ending in a forward slash
+/// @return 0 if every file was run, 1 otherwise
+static int run_pool(struct JobEntry *jobs, size_t num_jobs, char *dir_path){
+  if(num_jobs == 0){
+    return 0;
+  }
+
+  // Deadlines of the deferred commands are on the monotonic clock, so the waits must be too
+  pthread_condattr_t attr;
+  if(pthread_condattr_init(&attr) != 0) return 1;
+
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int cond_ret = pthread_cond_init(&pool_change, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if(cond_ret != 0) return 1;
+
+  pool_jobs = jobs;
+  num_pool_jobs = num_jobs;
+  pool_dir = dir_path;
+  atomic_init(&next_pool_job, 0);
+  atomic_init(&pool_failed, FALSE);
+
+  size_t max_files = (size_t)t_args.MAX_THREADS * POOL_FILES_PER_THREAD;
+  num_pool_files = num_jobs < max_files ? num_jobs : max_files;
+
+  // Slots are never moved once their writer runs, so the array is allocated once
+  pool_files = (struct PoolFile *)malloc(num_pool_files * sizeof(struct PoolFile));
+  if(!pool_files) return 1;
+
+  for(size_t i = 0; i < num_pool_files; i++){
+    if(init_timers(&pool_files[i].timers) != 0){
+      while(i-- > 0){
+        destroy_timers(&pool_files[i].timers);
+      }
+
+      free(pool_files);
+      return 1;
+    }
+
+    atomic_init(&pool_files[i].claim, 0);
+    atomic_init(&pool_files[i].remaining, 0);
+    atomic_init(&pool_files[i].finished, FALSE);
+  }
+
+  // Files come largest first, so they are the first ones the threads start with
+  for(size_t i = 0; i < num_pool_files; i++){
+    if(open_pool_file(&pool_files[i])){
+      advance_pool_file(&pool_files[i]);
+    }
+    else{
+      atomic_store(&pool_files[i].finished, TRUE);
+    }
+  }
+
+  pthread_t threads[t_args.MAX_THREADS]; // Thread array
+  unsigned int thread_ids[t_args.MAX_THREADS]; // Thread IDs array
+
+  for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+    thread_ids[i] = i+1;
+    if(pthread_create(&threads[i], NULL, &run_pool_worker, (void *)&thread_ids[i]) != 0){
+      fprintf(stderr, "Failed to create thread\n");
+      exit(1);
+    }
+  }
+
+  for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+    pthread_join(threads[i], NULL);
+  }
+
+  // Threads may still look at the timers of a slot after its last file is closed
+  for(size_t i = 0; i < num_pool_files; i++){
+    destroy_timers(&pool_files[i].timers);
+  }
+
+  free(pool_files);
+  pthread_cond_destroy(&pool_change);
+
+  if(t_args.cache_stats == TRUE){
+    print_cache_stats("every file");
+  }
+
+  return atomic_load(&pool_failed) == TRUE;
+}
+
+/// Runs a jobs file in this process, on threads of its own.
+/// @param dir_path Path of the jobs directory, ending in a forward slash
+/// @param file_name Name of the file inside of the jobs directory
+/// @param format Format of the file
+/// @return 0 if the file was run, 1 otherwise
+/// @note A file that fails may leave its output writer running and its file
+/// descriptors open, so the process must not run another one after it.
+static int run_file(char *dir_path, char *file_name, enum JobsFormat format){
+  // Open .jobs file and create respective .out file
+  if(open_file(dir_path, file_name, &(t_args.fd_jobs), &(t_args.fd_out)) < 0){
+    fprintf(stderr, "Failed to open file.\n");
+    return 1;
+  }
+
+  t_args.format = format;
+
+  if(start_writer(&t_args.writer, t_args.fd_out) != 0){
+    fprintf(stderr, "Failed to start output writer\n");
+    return 1;
+  }
+
+  if(format == BINARY_JOBS){
+    if(open_binary(&t_args.binary, t_args.fd_jobs) != 0){
+      fprintf(stderr, "Invalid binary jobs file.\n");
+      return 1;
+    }
+  }
+  else{
+    init_reader(&t_args.reader, t_args.fd_jobs);
+  }
+  
+  pthread_t threads[t_args.MAX_THREADS]; // Thread array
+  unsigned int thread_ids[t_args.MAX_THREADS]; // Thread IDs array
+
+  t_args.wait = (uint64_t *)malloc(t_args.MAX_THREADS * sizeof(uint64_t));
+  
+  if(!t_args.wait || init_timers(&t_args.timers) != 0) return 1;
+
+  for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+    t_args.wait[i] = 0;
+  }
+
+  init_segment(&t_args.segments[0]);
+  init_segment(&t_args.segments[1]);
+
+  t_args.finished = FALSE;
+  t_args.next_sequence = 0;
+
+  if(t_args.mode == SHARDED_MODE){
+    t_args.shards = (struct EventList **)malloc(t_args.MAX_THREADS * sizeof(struct EventList *));
+    t_args.queues = create_spsc_queues(t_args.MAX_THREADS);
+
+    if(!t_args.shards || !t_args.queues) return 1;
+
+    for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+      t_args.shards[i] = ems_create_shard();
+      if(!t_args.shards[i]) return 1;
+    }
+  }
+
+  if(t_args.mode == STREAMING_MODE){
+    t_args.stream = create_mpmc_queue();
+    if(!t_args.stream) return 1;
+  }
+
+  // Streaming threads only wait for each other, otherwise the main thread joins them
+  unsigned int barrier_count = t_args.mode == STREAMING_MODE ? t_args.MAX_THREADS : t_args.MAX_THREADS + 1;
+
+  if(pthread_barrier_init(&t_args.barrier, NULL, barrier_count) != 0){
+    fprintf(stderr, "Failed to initialize barrier\n");
+    return 1;
+  }
+
+  // Create the threads once for the whole file
+  for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+    thread_ids[i] = i+1;
+    if(pthread_create(&threads[i], NULL, t_args.mode == STREAMING_MODE ? &execute_stream : &execute_commands,
+                      (void *)&thread_ids[i]) != 0){
+      fprintf(stderr, "Failed to create thread\n");
+      exit(1);
+    }
+  }
+
+  if(t_args.mode == STREAMING_MODE){
+    stream_file();
+  }
+  else{
+    run_segments();
+  }
 
+  for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+    pthread_join(threads[i], NULL);
+  }
+  pthread_barrier_destroy(&t_args.barrier);
 
-pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+  if(t_args.mode == STREAMING_MODE){
+    free(t_args.stream);
+  }
 
+  if(t_args.mode == SHARDED_MODE){
+    for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
+      ems_free_shard(t_args.shards[i]);
+    }
 
-void *execute_commands(void *arg){
-  unsigned int event_id, delay, thread_id;
-  size_t num_rows, num_columns, num_coords;
-  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    free(t_args.shards);
+    free(t_args.queues);
+  }
 
-  unsigned int id = *(unsigned int *)arg; // Thread ID
+  if(stop_writer(&t_args.writer) != 0){
+    fprintf(stderr, "Failed to write output\n");
+  }
 
+  free_segment(&t_args.segments[0]);
+  free_segment(&t_args.segments[1]);
 
-  while(1){
-    if(pthread_mutex_lock(&barrier_lock) != 0){
-      fprintf(stderr, "Failed to lock mutex\n");
-      exit(1);
+  if(t_args.format == BINARY_JOBS){
+    close_binary(&t_args.binary);
+  }
+  
+  close(t_args.fd_jobs);
+  close(t_args.fd_out);
+
+  free(t_args.wait);
+  destroy_timers(&t_args.timers);
+
+  return 0;
+}
+
+/// Orders jobs files largest first, then by name.
+static int compare_jobs(const void *a, const void *b){
+  const struct JobEntry *x = (const struct JobEntry *)a;
+  const struct JobEntry *y = (const struct JobEntry *)b;
+
+  if(x->size != y->size){
+    return x->size > y->size ? -1 : 1;
+  }
+
+  return strcmp(x->name, y->name);
+}
+
+/// Checks if a .jobs file has been compiled into a .bjobs file of the same
+/// name, which would write to the same .out file.
+/// @param dir Directory of the file
+/// @param file_name Name of the .jobs file
+/// @return TRUE if the .bjobs file exists, FALSE otherwise
+static int has_binary_version(DIR *dir, const char *file_name){
+  size_t base_len = strlen(file_name) - strlen(JOBS_EXTENSION);
+  char binary_name[base_len + strlen(BINARY_JOBS_EXTENSION) + 1];
+  struct stat file_stat;
+
+  snprintf(binary_name, sizeof(binary_name), "%.*s%s", (int)base_len, file_name, BINARY_JOBS_EXTENSION);
+
+  return fstatat(dirfd(dir), binary_name, &file_stat, 0) == 0 ? TRUE : FALSE;
+}
+
+/// Lists the jobs files of a directory, largest first, so the longest ones
+/// start as early as possible. A .jobs file compiled into a .bjobs file next to
+/// it is left out, so only the .bjobs file runs.
+/// @param dir Directory to be listed
+/// @param jobs Pointer to the array of files found, to be freed with free_jobs
+/// @param num_jobs Pointer to the number of files found
+/// @return 0 if the directory was listed, 1 otherwise
+static int list_jobs(DIR *dir, struct JobEntry **jobs, size_t *num_jobs){
+  struct dirent *entry;
+  size_t capacity = 16;
+
+  *num_jobs = 0;
+  *jobs = (struct JobEntry *)malloc(capacity * sizeof(struct JobEntry));
+  if(!*jobs) return 1;
+
+  while((entry = readdir(dir)) != NULL){
+    enum JobsFormat format = jobs_format(entry->d_name);
+    struct stat file_stat;
+
+    if(format == NOT_JOBS || (format == TEXT_JOBS && has_binary_version(dir, entry->d_name))){
+      continue;
     }
 
-    // Check if barrier was encountered
-    if(t_args.barrier == TRUE){
-      if(pthread_mutex_unlock(&barrier_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-      return (void *) &t_args.barrier;
+    if(fstatat(dirfd(dir), entry->d_name, &file_stat, 0) != 0){
+      fprintf(stderr, "Failed to stat %s\n", entry->d_name);
+      continue;
     }
 
-    if(pthread_mutex_unlock(&barrier_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
+    if(*num_jobs == capacity){
+      capacity *= 2;
+      struct JobEntry *grown = (struct JobEntry *)realloc(*jobs, capacity * sizeof(struct JobEntry));
+      if(!grown) return 1;
+      *jobs = grown;
     }
 
+    struct JobEntry *job = &(*jobs)[*num_jobs];
+    job->name = strdup(entry->d_name);
+    job->format = format;
+    job->size = file_stat.st_size;
 
-    if(pthread_mutex_lock(&wait_lock) != 0){
-      fprintf(stderr, "Failed to lock mutex\n");
-      exit(1);
-    }
+    if(!job->name) return 1;
 
-    // Check if thread needs to wait
-    if(t_args.wait[id - 1] != 0){
-      fprintf(stdout, "Waiting...\n");
+    (*num_jobs)++;
+  }
 
-      unsigned int thread_delay = t_args.wait[id - 1];
-      
-      t_args.wait[id - 1] = 0;
-      
-      if(pthread_mutex_unlock(&wait_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
+  qsort(*jobs, *num_jobs, sizeof(struct JobEntry), compare_jobs);
 
-      ems_wait(thread_delay);
+  return 0;
+}
+
+/// Frees a list of jobs files.
+static void free_jobs(struct JobEntry *jobs, size_t num_jobs){
+  for(size_t i = 0; i < num_jobs; i++){
+    free(jobs[i].name);
+  }
+
+  free(jobs);
+}
+
+/// Waits for a child process to terminate and prints its status.
+/// @param pid Process ID of the child
+/// @return 0 if the child terminated normally, 1 otherwise
+static int reap_child(pid_t pid){
+  int status;
+  pid_t child_pid;
+
+  while((child_pid = waitpid(pid, &status, 0)) < 0 && errno == EINTR);
+
+  if(child_pid < 0 || !WIFEXITED(status)){
+    fprintf(stderr, "Failed to terminate child processor\n");
+    return 1;
+  }
+
+  // Print child termination status
+  fprintf(stdout, "Child process %d terminated with status %d\n", child_pid, status);
+
+  return 0;
+}
+
+/// Reads a whole message from a pipe.
+/// @param fd File descriptor to read from
+/// @param message Where to store the message
+/// @param size Size of the message
+/// @return 0 if the message was read, 1 at the end of the pipe or on error
+static int read_message(int fd, void *message, size_t size){
+  size_t done = 0;
+
+  while(done < size){
+    long int bytes_read = read(fd, (char *)message + done, size - done);
+
+    if(bytes_read < 0 && errno == EINTR) continue;
+    if(bytes_read <= 0) return 1;
+
+    done += (size_t)bytes_read;
+  }
+
+  return 0;
+}
+
+// Pre-forked process running jobs files sent by the main process
+struct Worker {
+  pid_t pid;         // process ID, -1 if not running
+  int to_worker;     // pipe with the indexes of the files to run
+  int from_worker;   // pipe with the status of each file run
+  size_t job;        // index of the file being run
+  int busy;          // TRUE while running a file
+};
+
+/// Runs the files sent by the main process until it closes the pipe, starting
+/// each one from a clean EMS state. The worker exits when a file fails, so the
+/// main process reports it and starts a new worker for the next files.
+/// @param from_parent Pipe with the indexes of the files to run
+/// @param to_parent Pipe to report the status of each file to
+/// @param jobs Jobs files of the directory
+/// @param dir_path Path of the jobs directory
+/// @param delay_ms State access delay in milliseconds
+static void run_worker(int from_parent, int to_parent, struct JobEntry *jobs, char *dir_path, unsigned int delay_ms){
+  size_t job;
+
+  while(read_message(from_parent, &job, sizeof(job)) == 0){
+    int status = run_file(dir_path, jobs[job].name, jobs[job].format);
+
+    // Closing the pipe without a status tells the main process the file failed
+    if(status != 0){
+      exit(1);
     }
-    else{
-      if(pthread_mutex_unlock(&wait_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
+
+    if(t_args.cache_stats == TRUE){
+      print_cache_stats(jobs[job].name);
     }
 
+    ems_terminate();
 
-    if(pthread_mutex_lock(&read_lock) != 0){
-      fprintf(stderr, "Failed to lock mutex\n");
+    if(ems_init(delay_ms)){
+      fprintf(stderr, "Failed to initialize EMS\n");
       exit(1);
     }
 
-    switch (get_next(t_args.fd_jobs)) {
-      case CMD_CREATE:
-        if (parse_create(t_args.fd_jobs, &event_id, &num_rows, &num_columns) != 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          
-          if(pthread_mutex_unlock(&read_lock) != 0){
-            fprintf(stderr, "Failed to unlock mutex\n");
-            exit(1);
-          }
-          continue;
-        }
+    if(write_buffer(to_parent, (const char *)&status, sizeof(status)) != 0){
+      exit(1);
+    }
+  }
 
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+  exit(0);
+}
 
-        if (ems_create(event_id, num_rows, num_columns)) {
-          fprintf(stderr, "Failed to create event\n");
-        }
+/// Forks a worker process connected to the main process by a pair of pipes.
+/// @param workers Every worker, whose pipes the new one closes
+/// @param num_workers Number of workers
+/// @param worker Worker to be started
+/// @return 0 if the worker was started, 1 otherwise
+static int spawn_worker(struct Worker *workers, unsigned int num_workers, struct Worker *worker,
+                        struct JobEntry *jobs, char *dir_path, unsigned int delay_ms){
+  int down[2], up[2];
 
-        break;
+  if(pipe(down) != 0){
+    return 1;
+  }
 
-      case CMD_RESERVE:
-        num_coords = parse_reserve(t_args.fd_jobs, MAX_RESERVATION_SIZE, &event_id, xs, ys);
-        
-        if (num_coords == 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          
-          if(pthread_mutex_unlock(&read_lock) != 0){
-            fprintf(stderr, "Failed to unlock mutex\n");
-            exit(1);
-          }
-          
-          continue;
-        }
+  if(pipe(up) != 0){
+    close(down[0]);
+    close(down[1]);
+    return 1;
+  }
 
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+  // Don't hand the child the statuses printed so far
+  fflush(stdout);
+  pid_t pid = fork();
 
-        if (ems_reserve(event_id, num_coords, xs, ys)) {
-          fprintf(stderr, "Failed to reserve seats\n");
-        }
+  if(pid < 0){
+    close(down[0]);
+    close(down[1]);
+    close(up[0]);
+    close(up[1]);
+    return 1;
+  }
 
-        break;
+  if(pid == 0){ // Child process
+    // Only the main process may hold the other ends, or workers would never see the pipes close
+    for(unsigned int i = 0; i < num_workers; i++){
+      if(workers[i].pid > 0){
+        close(workers[i].to_worker);
+        close(workers[i].from_worker);
+      }
+    }
 
-      case CMD_SHOW:
-        if (parse_show(t_args.fd_jobs, &event_id) != 0) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          
-          if(pthread_mutex_unlock(&read_lock) != 0){
-            fprintf(stderr, "Failed to unlock mutex\n");
-            exit(1);
-          }
-          
-          continue;
-        }
+    close(down[1]);
+    close(up[0]);
 
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+    run_worker(down[0], up[1], jobs, dir_path, delay_ms);
+  }
 
-        if (ems_show(event_id, t_args.fd_out)) {
-          fprintf(stderr, "Failed to show event\n");
-        }
+  close(down[0]);
+  close(up[1]);
 
-        break;
+  worker->pid = pid;
+  worker->to_worker = down[1];
+  worker->from_worker = up[0];
+  worker->busy = FALSE;
 
-      case CMD_LIST_EVENTS:
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+  return 0;
+}
 
-        if (ems_list_events(t_args.fd_out)) {
-          fprintf(stderr, "Failed to list events\n");
-        }
+/// Closes the pipes of a worker and waits for it to terminate.
+/// @param worker Worker to be stopped
+/// @return 0 if the worker terminated normally, 1 otherwise
+static int stop_worker(struct Worker *worker){
+  close(worker->to_worker);
+  close(worker->from_worker);
 
-        break;
+  int ret = reap_child(worker->pid);
+  worker->pid = -1;
 
-      case CMD_WAIT:
-        int wait_ret = parse_wait(t_args.fd_jobs, &delay, &thread_id);
+  return ret;
+}
 
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+/// Runs every jobs file on a fixed set of pre-forked worker processes, sending
+/// each file to the first worker to become idle.
+/// @param jobs Jobs files of the directory, in the order to run them
+/// @param num_jobs Number of jobs files
+/// @param max_proc Number of worker processes
+/// @param dir_path Path of the jobs directory
+/// @param delay_ms State access delay in milliseconds
+/// @return 0 if every file ran successfully, 1 otherwise
+static int run_process_pool(struct JobEntry *jobs, size_t num_jobs, unsigned int max_proc, char *dir_path,
+                            unsigned int delay_ms){
+  unsigned int num_workers = num_jobs < max_proc ? (unsigned int)num_jobs : max_proc;
+
+  if(num_workers == 0){
+    return 0;
+  }
 
-        if (wait_ret == -1) {
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          continue;
-        }
-        // Set delay for all threads
-        else if(wait_ret == 0){
-          if(delay > 0){
-            if(pthread_mutex_lock(&wait_lock) != 0){
-              fprintf(stderr, "Failed to lock mutex\n");
-              exit(1);
-            }
-            
-            for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
-              t_args.wait[i] = delay;
-            }
-            
-            if(pthread_mutex_unlock(&wait_lock) != 0){
-              fprintf(stderr, "Failed to unlock mutex\n");
-              exit(1);
-            }
-          }
-        }
-        // Set delay for the indicated thread
-        else if(wait_ret == 1){
-          if(thread_id <= t_args.MAX_THREADS){
-            if(delay > 0){
-              
-              if(pthread_mutex_lock(&wait_lock) != 0){
-                fprintf(stderr, "Failed to lock mutex\n");
-                exit(1);
-              }
-              
-              t_args.wait[thread_id - 1] = delay;
-              
-              if(pthread_mutex_unlock(&wait_lock) != 0){
-                fprintf(stderr, "Failed to unlock mutex\n");
-                exit(1);
-              }
-            }
-          }
-          else{
-            fprintf(stderr, "Invalid thread_id\n");
-            
-            continue;
-          }
-        }
+  // A worker that died must not take the main process with it when sent a file
+  signal(SIGPIPE, SIG_IGN);
 
-        break;
+  struct Worker workers[num_workers];
+  struct pollfd fds[num_workers];
+  size_t next_job = 0;
+  size_t done = 0;
+  int ret = 0;
 
-      case CMD_INVALID:
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+  for(unsigned int i = 0; i < num_workers; i++){
+    workers[i].pid = -1;
+  }
 
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
-        
-        break;
+  while(done < num_jobs){
+    // Hand the next files to idle workers, replacing the ones that died
+    for(unsigned int i = 0; i < num_workers && next_job < num_jobs; i++){
+      if(workers[i].pid > 0 && workers[i].busy == TRUE){
+        continue;
+      }
 
-      case CMD_HELP:
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
-        
-        printf(
-            "Available commands:\n"
-            "  CREATE <event_id> <num_rows> <num_columns>\n"
-            "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
-            "  SHOW <event_id>\n"
-            "  LIST\n"
-            "  WAIT <delay_ms> [thread_id]\n"
-            "  BARRIER\n"
-            "  HELP\n");
-        
-        break;
+      if(workers[i].pid < 0 && spawn_worker(workers, num_workers, &workers[i], jobs, dir_path, delay_ms) != 0){
+        fprintf(stderr, "Failed to create process.\n");
+        return 1;
+      }
 
-      case CMD_BARRIER:
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
-        
-        if(pthread_mutex_lock(&barrier_lock) != 0){
-          fprintf(stderr, "Failed to lock mutex\n");
-          exit(1);
-        }
-        
-        t_args.barrier = TRUE;
-        
-        if(pthread_mutex_unlock(&barrier_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
+      if(write_buffer(workers[i].to_worker, (const char *)&next_job, sizeof(next_job)) != 0){
+        stop_worker(&workers[i]);
+        i--;
+        continue;
+      }
 
-        return (void *) &t_args.barrier;
+      workers[i].job = next_job++;
+      workers[i].busy = TRUE;
+    }
 
-      case CMD_EMPTY:
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
-        
-        break;
+    for(unsigned int i = 0; i < num_workers; i++){
+      fds[i].fd = workers[i].pid > 0 && workers[i].busy == TRUE ? workers[i].from_worker : -1;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
 
-      case EOC:
-        if(pthread_mutex_unlock(&read_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
-        
-        return (void *) &t_args.barrier;
+    if(poll(fds, num_workers, -1) < 0){
+      if(errno == EINTR) continue;
+      fprintf(stderr, "Failed to wait for processes\n");
+      return 1;
+    }
+
+    for(unsigned int i = 0; i < num_workers; i++){
+      if(fds[i].revents == 0){
+        continue;
+      }
+
+      int status;
+
+      // The pipe only closes early if the worker died in the middle of the file
+      if(read_message(workers[i].from_worker, &status, sizeof(status)) != 0){
+        stop_worker(&workers[i]);
+        status = 1;
+      }
+
+      fprintf(stdout, "File %s finished with status %d\n", jobs[workers[i].job].name, status);
+
+      if(status != 0){
+        ret = 1;
+      }
+
+      workers[i].busy = FALSE;
+      done++;
     }
   }
 
-  return (void *) &t_args.barrier;
-}
+  // Closing the pipes tells the workers there are no more files
+  for(unsigned int i = 0; i < num_workers; i++){
+    if(workers[i].pid > 0 && stop_worker(&workers[i]) != 0){
+      ret = 1;
+    }
+  }
 
+  return ret;
+}
 
 int main(int argc, char *argv[]) {
   unsigned int state_access_delay_ms = STATE_ACCESS_DELAY_MS;
 
+  t_args.mode = SEGMENT_MODE;
+
+  int opt;
+  while((opt = getopt(argc, argv, "spwci:")) != -1){
+    if(opt == 'c'){
+      t_args.cache_stats = TRUE;
+      continue;
+    }
+
+    // SHOW prints snapshots published every given number of reservations
+    if(opt == 'i'){
+      char *endptr;
+      unsigned long int interval = strtoul(optarg, &endptr, 10);
+
+      if (*optarg == '\0' || *endptr != '\0' || interval > UINT_MAX) {
+        fprintf(stderr, "Invalid snapshot interval\n");
+        return 1;
+      }
+
+      ems_set_snapshot_interval((unsigned int)interval);
+      continue;
+    }
+
+    if(opt != 's' && opt != 'p' && opt != 'w'){
+      fprintf(stderr, "Usage: %s [-s | -p | -w] [-c] [-i interval] <jobs_dir> <max_proc> <max_threads> [delay]\n",
+              argv[0]);
+      return 1;
+    }
+
+    if(t_args.mode != SEGMENT_MODE){
+      fprintf(stderr, "Options -s, -p and -w can't be combined\n");
+      return 1;
+    }
+
+    t_args.mode = opt == 's' ? SHARDED_MODE : opt == 'p' ? STREAMING_MODE : POOL_MODE;
+  }
+
+  // Leave the positional arguments where they would be without options
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if(argc < 4){
     fprintf(stderr, "Insufficient arguments\n");
     return 1;
@@ -317,6 +1642,12 @@ int main(int argc, char *argv[]) {
   const unsigned int MAX_PROC = (unsigned int)atoi(argv[2]);
   t_args.MAX_THREADS = (unsigned int)atoi(argv[3]);
 
+  // Every file runs in this process in pool mode, so only the others need workers
+  if(MAX_PROC == 0 && t_args.mode != POOL_MODE){
+    fprintf(stderr, "Invalid number of processes\n");
+    return 1;
+  }
+
   // Set delay
   if (argc == 5) {
     char *endptr;
@@ -347,110 +1678,34 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Failed to open directory.\n");
     return 1;
   }
-  struct dirent *entry;
-
-  unsigned int num_active_proc = 0; 
-
-  while ((entry = readdir(dir))!= NULL) {
-    if(strstr(entry->d_name, ".jobs") != NULL){
-      // Wait for child processes to terminate
-      if(num_active_proc >= MAX_PROC){
-        int status;
-        pid_t child_pid = wait(&status);
-
-        if(WIFEXITED(status)){
-          if(WEXITSTATUS(status) == -1){
-            fprintf(stderr,"Error while terminating child processor\n");
-            return 1;
-          }
-          // Print child termination status
-          fprintf(stdout, "Child process %d terminated with status %d\n", child_pid, status);
-          
-          num_active_proc--;
-        }
-        else{
-          fprintf(stderr, "Failed to terminate child processor\n");
-          return 1;
-        }
-      }
-      
-      // Fork child process
-      num_active_proc++;
-      pid_t pid = fork();
 
-      if(pid < 0){
-        fprintf(stderr, "Failed to create process.\n");
-        return 1;
-      }
-      else if(pid == 0){ // Child process
-        
-        // Open .jobs file and create respective .out file
-        if(open_file(argv[1], entry->d_name, &(t_args.fd_jobs), &(t_args.fd_out)) < 0){
-          fprintf(stderr, "Failed to open file.\n");
-          return 1;
-        }
-        
-        pthread_t threads[t_args.MAX_THREADS]; // Thread array
-        unsigned int thread_ids[t_args.MAX_THREADS]; // Thread IDs array
+  // Stat every jobs file first, to start the largest ones first
+  struct JobEntry *jobs;
+  size_t num_jobs;
 
-        t_args.wait = (unsigned int *)malloc(t_args.MAX_THREADS * sizeof(unsigned int));
-        
-        if(!t_args.wait) return 1;
-
-        int continue_reading_file = TRUE; // TRUE if a barrier is found and FALSE if the file ended
-
-        while(continue_reading_file == TRUE){
-          int *thread_ret;
-
-          for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
-            t_args.wait[i] = 0;
-          }
+  if(list_jobs(dir, &jobs, &num_jobs) != 0){
+    fprintf(stderr, "Failed to list directory.\n");
+    return 1;
+  }
 
-          t_args.barrier = FALSE;
+  closedir(dir);
 
-          // Create and execute threads
-          for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
-            thread_ids[i] = i+1;
-            pthread_create(&threads[i], NULL, &execute_commands, (void *)&thread_ids[i]);
-          }
-          for(unsigned int i = 0; i < t_args.MAX_THREADS; i++){
-            pthread_join(threads[i], (void **) &thread_ret);
-          }
-          continue_reading_file = *thread_ret;
-        }
-        
-        close(t_args.fd_jobs);
-        close(t_args.fd_out);
+  // Every file runs in this process instead of a child of its own
+  if(t_args.mode == POOL_MODE){
+    int pool_ret = run_pool(jobs, num_jobs, argv[1]);
 
-        free(t_args.wait);
+    free_jobs(jobs, num_jobs);
+    ems_terminate();
 
-        exit(0);
-      }
-    }
+    return pool_ret;
   }
 
-  // Wait for remaining child processes to terminate
-  for(unsigned int i = 0; i < MAX_PROC; i++){
-    int status;
-    pid_t child_pid = wait(&status);
+  // Files go to pre-forked processes, instead of a fork for each one
+  int pool_ret = run_process_pool(jobs, num_jobs, MAX_PROC, argv[1], state_access_delay_ms);
+
+  free_jobs(jobs, num_jobs);
 
-    if(WIFEXITED(status)){
-      if(WEXITSTATUS(status) == -1){
-        fprintf(stderr,"Error while terminating child processor\n");
-        return 1;
-      }
-      // Print child termination status
-      fprintf(stdout, "Child process %d terminated with status %d\n", child_pid, status);
-      
-      num_active_proc--;
-    }
-    else{
-      fprintf(stderr, "Failed to terminate child processor\n");
-      return 1;
-    }
-  }
-  
-  closedir(dir);
-  
   ems_terminate();
+
+  return pool_ret;
 }
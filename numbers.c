@@ -0,0 +1,140 @@
+#include "numbers.h"
+
+#include <string.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_LITTLE_ENDIAN 1
+#else
+#define SWAR_LITTLE_ENDIAN 0
+#endif
+
+#define REPEAT_BYTE(b) (0x0101010101010101ULL * (b))
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// Counts the decimal digits of a number.
+static size_t count_digits(unsigned int value) {
+  size_t digits = 1;
+  while (value >= 10000) {
+    value /= 10000;
+    digits += 4;
+  }
+  if (value >= 1000) return digits + 3;
+  if (value >= 100) return digits + 2;
+  if (value >= 10) return digits + 1;
+  return digits;
+}
+
+size_t format_uint(unsigned int value, char *out) {
+  size_t digits = count_digits(value);
+  char *end = out + digits;
+
+  while (value >= 100) {
+    unsigned int pair = (value % 100) * 2;
+    value /= 100;
+    end -= 2;
+    end[0] = digit_pairs[pair];
+    end[1] = digit_pairs[pair + 1];
+  }
+
+  if (value >= 10) {
+    end -= 2;
+    end[0] = digit_pairs[value * 2];
+    end[1] = digit_pairs[value * 2 + 1];
+  } else {
+    end[-1] = (char)('0' + value);
+  }
+
+  return digits;
+}
+
+size_t format_uint_row(const unsigned int *values, size_t n, char *out) {
+  char *start = out;
+  size_t i = 0;
+
+  while (i < n) {
+#if SWAR_LITTLE_ENDIAN
+    // Four single digit values followed by at least one more value become
+    // "a b c d " in a single store
+    if (i + 4 < n && values[i] < 10 && values[i + 1] < 10 && values[i + 2] < 10 && values[i + 3] < 10) {
+      uint64_t chunk = 0x2030203020302030ULL;  // "0 0 0 0 " in memory order
+      chunk += (uint64_t)values[i] | (uint64_t)values[i + 1] << 16 | (uint64_t)values[i + 2] << 32 |
+               (uint64_t)values[i + 3] << 48;
+      memcpy(out, &chunk, sizeof(chunk));
+      out += sizeof(chunk);
+      i += 4;
+      continue;
+    }
+#endif
+
+    out += format_uint(values[i], out);
+    if (i + 1 < n) *out++ = ' ';
+    i++;
+  }
+
+  return (size_t)(out - start);
+}
+
+/// Combines eight ASCII digits, the first one in the lowest byte, into their value.
+static uint64_t combine_digits(uint64_t chunk) {
+  chunk -= REPEAT_BYTE('0');
+  chunk = (chunk * 10 + (chunk >> 8)) & 0x00ff00ff00ff00ffULL;
+  chunk = (chunk * 100 + (chunk >> 16)) & 0x0000ffff0000ffffULL;
+  chunk = (chunk * 10000 + (chunk >> 32)) & 0x00000000ffffffffULL;
+  return chunk;
+}
+
+size_t parse_digits(const char *s, size_t len, uint64_t *value) {
+  uint64_t result = 0;
+  size_t digits = 0;
+
+#if SWAR_LITTLE_ENDIAN
+  while (len - digits >= 8) {
+    uint64_t chunk;
+    memcpy(&chunk, s + digits, sizeof(chunk));
+
+    // A byte is a digit when its high nibble is 3 and adding 6 keeps it there
+    uint64_t not_digit = ((chunk & REPEAT_BYTE(0xf0)) ^ REPEAT_BYTE(0x30)) |
+                         (((chunk + REPEAT_BYTE(0x06)) & REPEAT_BYTE(0xf0)) ^ REPEAT_BYTE(0x30));
+
+    size_t run = not_digit == 0 ? 8 : (size_t)__builtin_ctzll(not_digit) / 8;
+
+    if (run == 0) break;
+
+    // Move the digits to the top bytes, padding the bottom with '0'
+    if (run < 8) {
+      chunk = chunk << (8 * (8 - run)) | (REPEAT_BYTE('0') >> (8 * run));
+    }
+
+    if (digits + run <= 19) {
+      uint64_t scale = 1;
+      for (size_t k = 0; k < run; k++) scale *= 10;
+      result = result * scale + combine_digits(chunk);
+    }
+
+    digits += run;
+
+    if (run < 8) {
+      *value = result;
+      return digits;
+    }
+  }
+#endif
+
+  for (; digits < len && s[digits] >= '0' && s[digits] <= '9'; digits++) {
+    if (digits < 19) result = result * 10 + (uint64_t)(s[digits] - '0');
+  }
+
+  *value = result;
+  return digits;
+}
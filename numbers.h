@@ -0,0 +1,32 @@
+#ifndef EMS_NUMBERS_H
+#define EMS_NUMBERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_UINT_DIGITS 10  // Digits of the largest unsigned int
+
+/// Writes the decimal representation of a number, two digits at a time.
+/// @param value Number to be written.
+/// @param out Buffer with room for MAX_UINT_DIGITS characters. No terminator is written.
+/// @return Number of characters written.
+size_t format_uint(unsigned int value, char *out);
+
+/// Writes a row of numbers separated by spaces, handling runs of single digit
+/// numbers four at a time with one 64 bit store.
+/// @param values Numbers to be written.
+/// @param n Number of values.
+/// @param out Buffer with room for n * (MAX_UINT_DIGITS + 1) characters. No
+/// terminator or trailing space is written.
+/// @return Number of characters written.
+size_t format_uint_row(const unsigned int *values, size_t n, char *out);
+
+/// Parses the decimal digits at the start of a buffer, eight at a time.
+/// @param s Buffer to parse.
+/// @param len Number of characters available in the buffer.
+/// @param value Pointer to the variable to store the number in. Only meaningful
+/// when at most 19 digits were found.
+/// @return Number of consecutive digits at the start of the buffer.
+size_t parse_digits(const char *s, size_t len, uint64_t *value);
+
+#endif  // EMS_NUMBERS_H
@@ -3,15 +3,57 @@
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
+#include <sched.h>
+#include <stdint.h>
 
 #include "eventlist.h"
 #include "filehandler.h"
+#include "numbers.h"
+#include "operations.h"
 #include "sort.h"
+#include "writer.h"
 
 static struct EventList* event_list = NULL;
+
+/// State bound to each thread with ems_use_state, used instead of event_list when set.
+static _Thread_local struct EventList* bound_state = NULL;
 static unsigned int state_access_delay_ms = 0;
 
-pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+/// Reservations of an event between the snapshots published for SHOW, 0 if events have none.
+static unsigned int snapshot_interval = SNAPSHOT_INTERVAL;
+
+/// Output buffer where each thread renders a SHOW or LIST, handed to the writer once complete.
+static _Thread_local struct OutputBuffer output_buffer = {NULL, 0, 0};
+
+/// Reservation IDs of the event being shown by each thread, copied from its seats.
+static _Thread_local unsigned int* snapshot = NULL;
+static _Thread_local size_t snapshot_capacity = 0;
+
+/// Seats of each row of the event being copied by each thread, kept off the
+/// stack since events can have millions of rows.
+static _Thread_local atomic_uint** snapshot_rows = NULL;
+static _Thread_local size_t snapshot_rows_capacity = 0;
+
+// Event handle cached by a thread, valid while the generation it was filled in lasts
+struct CachedEvent {
+  struct EventList* list;  // State the event belongs to, NULL on empty entries
+  struct Event* event;     // Event found in the state
+};
+
+/// Direct-mapped cache of the events each thread has looked up, indexed by event ID.
+static _Thread_local struct CachedEvent event_cache[EVENT_CACHE_SIZE];
+static _Thread_local unsigned int cache_generation = 0;
+
+/// Bumped whenever a state is freed, so no thread keeps handles to its events.
+static atomic_uint state_generation = 1;
+
+/// Lookups served by the event caches and lookups that had to go to the state, since ems_init.
+static atomic_size_t cache_hits = 0;
+static atomic_size_t cache_misses = 0;
+
+/// Gets the state the calling thread operates on.
+/// @return State bound to the thread, or the one of ems_init if there is none.
+static struct EventList* current_state() { return bound_state != NULL ? bound_state : event_list; }
 
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
@@ -22,34 +64,905 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
 
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @param list Event list to search, the global one or a shard.
 /// @param event_id The ID of the event to get.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id) {
+static struct Event* get_event_with_delay(struct EventList* list, unsigned int event_id) {
   struct timespec delay = delay_to_timespec(state_access_delay_ms);
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return get_event(event_list, event_id);
+  return get_event(list, event_id);
 }
 
-/// Gets the seat with the given index from the state.
-/// @note Will wait to simulate a real system accessing a costly memory resource.
-/// @param event Event to get the seat from.
-/// @param index Index of the seat to get.
-/// @return Pointer to the seat.
-static struct Seat* get_seat_with_delay(struct Event* event, size_t index) {
+/// Gets the event with the given ID from the cache of the calling thread.
+/// @param list Event list the event belongs to, the global one or a shard.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if cached, NULL otherwise.
+static struct Event* get_cached_event(struct EventList* list, unsigned int event_id) {
+  unsigned int generation = atomic_load_explicit(&state_generation, memory_order_acquire);
+
+  // A state was freed since the cache was filled, so its handles may dangle
+  if (generation != cache_generation) {
+    memset(event_cache, 0, sizeof(event_cache));
+    cache_generation = generation;
+  }
+
+  struct CachedEvent* entry = &event_cache[event_id & (EVENT_CACHE_SIZE - 1)];
+
+  if (entry->list == list && entry->event->id == event_id) {
+    atomic_fetch_add_explicit(&cache_hits, 1, memory_order_relaxed);
+    return entry->event;
+  }
+
+  atomic_fetch_add_explicit(&cache_misses, 1, memory_order_relaxed);
+  return NULL;
+}
+
+/// Stores an event in the cache of the calling thread.
+/// @note Events are never removed from a state, so the handle stays valid until the state is freed.
+/// @param list Event list the event belongs to.
+/// @param event Event to be cached.
+static void cache_event(struct EventList* list, struct Event* event) {
+  struct CachedEvent* entry = &event_cache[event->id & (EVENT_CACHE_SIZE - 1)];
+  entry->list = list;
+  entry->event = event;
+}
+
+/// Invalidates the event caches of every thread, before a state is freed.
+static void invalidate_event_caches() { atomic_fetch_add_explicit(&state_generation, 1, memory_order_release); }
+
+/// Gets an event of a state shared by the threads, through the cache of the
+/// calling thread first, taking the list lock only on a miss.
+/// @param list Event list to search.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* find_event(struct EventList* list, unsigned int event_id) {
+  struct Event* event = get_cached_event(list, event_id);
+
+  if (event != NULL) {
+    return event;
+  }
+
+  if(pthread_rwlock_rdlock(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to lock rwlock\n");
+    exit(1);
+  }
+
+  event = get_event_with_delay(list, event_id);
+  
+  if(pthread_rwlock_unlock(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to unlock rwlock\n");
+    exit(1);
+  }
+
+  if (event != NULL) {
+    cache_event(list, event);
+  }
+
+  return event;
+}
+
+/// Gets an event of a shard, through the cache of the calling thread first.
+/// @param shard Shard owned by the calling thread.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* find_shard_event(struct EventList* shard, unsigned int event_id) {
+  struct Event* event = get_cached_event(shard, event_id);
+
+  if (event == NULL) {
+    event = get_event_with_delay(shard, event_id);
+
+    if (event != NULL) {
+      cache_event(shard, event);
+    }
+  }
+
+  return event;
+}
+
+/// Gets the index of a seat.
+/// @note This function assumes that the seat exists.
+/// @param event Event to get the seat index from.
+/// @param row Row of the seat.
+/// @param col Column of the seat.
+/// @return Index of the seat.
+static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
+
+/// Gets the seats of a row from a given column on from the state.
+/// @note Will wait to simulate a real system accessing a costly memory resource,
+/// once for the whole range.
+/// @param event Event to get the seats from.
+/// @param row Row of the seats.
+/// @param col_start Column of the first seat of the range.
+/// @return Pointer to the reservation ID of the first seat, followed by the
+/// ones of the rest of the row.
+static atomic_uint* get_seat_range_with_delay(struct Event* event, size_t row, size_t col_start) {
   struct timespec delay = delay_to_timespec(state_access_delay_ms);
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return &event->data[index];
-}
+  return &event->data[seat_index(event, row, col_start)];
+}
+
+/// Gets the seats of a reservation from the state, with one access for each
+/// row it touches.
+/// @param event Event of the reservation.
+/// @param num_seats Number of seats.
+/// @param seats Sorted indexes of the seats.
+/// @param seat_ptrs Where to store the reservation ID of each seat.
+static void get_seats_with_delay(struct Event* event, size_t num_seats, size_t* seats, atomic_uint** seat_ptrs) {
+  size_t i = 0;
+
+  while (i < num_seats) {
+    // The seats of a row are next to each other once sorted
+    size_t row = seats[i] / event->cols + 1;
+    size_t first = seats[i];
+    atomic_uint* range = get_seat_range_with_delay(event, row, first % event->cols + 1);
+
+    for (; i < num_seats && seats[i] / event->cols + 1 == row; i++) {
+      seat_ptrs[i] = range + (seats[i] - first);
+    }
+  }
+}
+
+/// Marks the start of the commit phase of a reservation, from claiming its
+/// first seat to giving the last one its reservation ID. SHOW retries any copy
+/// of the seats that overlaps one.
+/// @param event Event of the reservation.
+static void begin_commit(struct Event* event) {
+  atomic_fetch_add_explicit(&event->version, 1, memory_order_relaxed);
+
+  // Keeps the seat writes from becoming visible before the commit phase does
+  atomic_thread_fence(memory_order_release);
+}
+
+/// Marks the end of the commit phase of a reservation.
+/// @param event Event of the reservation.
+static void end_commit(struct Event* event) {
+  // One more commit in the high half, one less in progress in the low half
+  atomic_fetch_add_explicit(&event->version, ((uint64_t)1 << 32) - 1, memory_order_release);
+}
+
+/// Marks the end of the commit phase of a reservation that failed to claim its
+/// seats, so it isn't counted as a commit.
+/// @param event Event of the reservation.
+static void abort_commit(struct Event* event) {
+  atomic_fetch_sub_explicit(&event->version, 1, memory_order_release);
+}
+
+/// Fetches the seats of every row of an event from the state.
+/// @param event Event to fetch the seats of.
+/// @param rows Where to store the seats of each row.
+static void get_rows_with_delay(struct Event* event, atomic_uint** rows) {
+  for (size_t i = 0; i < event->rows; i++) {
+    rows[i] = event->cols > 0 ? get_seat_range_with_delay(event, i + 1, 1) : NULL;
+  }
+}
+
+/// Makes room for the seats of every row of an event in the row buffer of the
+/// calling thread.
+/// @param event Event to be copied.
+/// @return Row buffer of the thread, NULL if memory ran out.
+static atomic_uint** reserve_rows(struct Event* event) {
+  if (snapshot_rows_capacity < event->rows) {
+    atomic_uint** rows = realloc(snapshot_rows, event->rows * sizeof(atomic_uint*));
+
+    if (rows == NULL) {
+      return NULL;
+    }
+
+    snapshot_rows = rows;
+    snapshot_rows_capacity = event->rows;
+  }
+
+  return snapshot_rows;
+}
+
+/// Copies the reservation IDs of every seat of an event in a single pass.
+/// @param event Event to be copied.
+/// @param rows Seats of each row of the event.
+/// @param seats Where to copy the reservation IDs to.
+/// @param version Where to store the version of the event the copy was made at.
+/// @return 0 if the copy is consistent, 1 if a reservation committed meanwhile.
+static int try_copy_seats(struct Event* event, atomic_uint** rows, unsigned int* seats, uint64_t* version) {
+  *version = atomic_load_explicit(&event->version, memory_order_acquire);
+
+  if ((*version & UINT32_MAX) != 0) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < event->rows; i++) {
+    for (size_t j = 0; j < event->cols; j++) {
+      seats[i * event->cols + j] = atomic_load_explicit(&rows[i][j], memory_order_relaxed);
+    }
+  }
+
+  // Keeps the seat reads from moving past the second look at the version
+  atomic_thread_fence(memory_order_acquire);
+
+  return atomic_load_explicit(&event->version, memory_order_relaxed) != *version;
+}
+
+/// Copies the reservation IDs of every seat of an event into the snapshot of
+/// the calling thread, retrying until no reservation committed meanwhile.
+/// @param event Event to be copied.
+/// @param rows Seats of each row of the event.
+static void copy_seats(struct Event* event, atomic_uint** rows) {
+  uint64_t version;
+
+  while (try_copy_seats(event, rows, snapshot, &version) != 0) {
+    sched_yield();
+  }
+}
+
+/// Takes a reference to the published snapshot of an event.
+/// @param event Event with snapshots enabled.
+/// @return Published snapshot, to be released with release_snapshot.
+static struct SeatSnapshot* acquire_snapshot(struct Event* event) {
+  if(pthread_mutex_lock(&event->snapshot_lock) != 0){
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  struct SeatSnapshot* published = event->published;
+  atomic_fetch_add_explicit(&published->refs, 1, memory_order_relaxed);
+
+  if(pthread_mutex_unlock(&event->snapshot_lock) != 0){
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  return published;
+}
+
+/// Drops a reference to a snapshot, freeing it once nobody holds one.
+/// @param snapshot_ref Snapshot to be released.
+static void release_snapshot(struct SeatSnapshot* snapshot_ref) {
+  if (atomic_fetch_sub_explicit(&snapshot_ref->refs, 1, memory_order_acq_rel) == 1) {
+    free(snapshot_ref);
+  }
+}
+
+/// Copies the seats of an event into a new snapshot and publishes it. Unless
+/// forced, the copy gives up on the first reservation in progress instead of
+/// waiting for it.
+/// @param event Event with snapshots enabled.
+/// @param rows Seats of each row of the event.
+/// @param force 1 to retry the copy until it is consistent, or until another
+/// thread publishes a snapshot meanwhile.
+/// @return New snapshot with a reference held by the caller, NULL if a
+/// reservation committed during the copy or memory ran out.
+static struct SeatSnapshot* publish_snapshot(struct Event* event, atomic_uint** rows, int force) {
+  struct SeatSnapshot* fresh = malloc(sizeof(struct SeatSnapshot) + event->rows * event->cols * sizeof(unsigned int));
+
+  if (fresh == NULL) {
+    return NULL;
+  }
+
+  while (try_copy_seats(event, rows, fresh->seats, &fresh->version) != 0) {
+    if (!force || atomic_load_explicit(&event->unpublished, memory_order_relaxed) < snapshot_interval) {
+      free(fresh);
+      return NULL;
+    }
+
+    sched_yield();
+  }
+
+  // One reference for the caller and one while published
+  atomic_init(&fresh->refs, 2);
+
+  if(pthread_mutex_lock(&event->snapshot_lock) != 0){
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  // Another thread may have published a newer copy meanwhile
+  struct SeatSnapshot* old = event->published;
+
+  if (old->version >> 32 < fresh->version >> 32) {
+    event->published = fresh;
+  }
+  else {
+    old = fresh;
+  }
+
+  if(pthread_mutex_unlock(&event->snapshot_lock) != 0){
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  release_snapshot(old);
+  atomic_store_explicit(&event->unpublished, 0, memory_order_relaxed);
+
+  return fresh;
+}
+
+#if LOCK_FREE_RESERVE
+
+/// Claims a free seat for a reservation in progress by swapping its
+/// reservation ID for SEAT_PENDING.
+/// @note Waits while another reservation holds the seat, so that reservations
+/// claiming seats in sorted order behave like the ones taking seat locks.
+/// @param seat Seat to claim.
+/// @return 0 if the seat was claimed, 1 if it is already reserved.
+static int claim_seat(atomic_uint* seat) {
+  while (1) {
+    unsigned int expected = 0;
+
+    if (atomic_compare_exchange_weak(seat, &expected, SEAT_PENDING)) {
+      return 0;
+    }
+
+    if (expected != SEAT_PENDING && expected != 0) {
+      return 1;
+    }
+
+    sched_yield();
+  }
+}
+
+/// Claims the seats of a reservation one by one, in sorted order.
+/// @param num_seats Number of seats.
+/// @param seat_ptrs Reservation ID of each seat, in sorted order.
+/// @return 0 if every seat was claimed, 1 if one is already reserved, in which
+/// case no seat is left claimed.
+static int claim_seats(size_t num_seats, atomic_uint** seat_ptrs) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (claim_seat(seat_ptrs[i]) != 0) {
+      // Give back the seats claimed so far
+      for (size_t j = 0; j < i; j++) {
+        atomic_store(seat_ptrs[j], 0);
+      }
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/// Gives each claimed seat its reservation ID.
+/// @param num_seats Number of seats.
+/// @param seat_ptrs Reservation ID of each seat.
+/// @param reservation_id Reservation ID of the seats.
+static void release_seats(size_t num_seats, atomic_uint** seat_ptrs, unsigned int reservation_id) {
+  for (size_t j = 0; j < num_seats; j++) {
+    atomic_store(seat_ptrs[j], reservation_id);
+  }
+}
+
+#else
+
+/// Gets the mask with the seat lock guarding a row.
+/// @param event Event of the row.
+/// @param row Row of the seats.
+/// @return Mask with the bit of the lock set.
+static uint64_t row_stripe(struct Event* event, size_t row) {
+  return (uint64_t)1 << ((row - 1) % event->num_seat_locks);
+}
+
+/// Locks every seat lock in the mask, in increasing order.
+static void lock_stripes(struct Event* event, uint64_t stripes) {
+  for (size_t i = 0; i < event->num_seat_locks; i++) {
+    if ((stripes >> i & 1) && pthread_mutex_lock(&event->seat_locks[i]) != 0) {
+      fprintf(stderr, "Failed to lock mutex\n");
+      exit(1);
+    }
+  }
+}
+
+/// Unlocks every seat lock in the mask.
+static void unlock_stripes(struct Event* event, uint64_t stripes) {
+  for (size_t i = 0; i < event->num_seat_locks; i++) {
+    if ((stripes >> i & 1) && pthread_mutex_unlock(&event->seat_locks[i]) != 0) {
+      fprintf(stderr, "Failed to unlock mutex\n");
+      exit(1);
+    }
+  }
+}
+
+/// Gets the mask with the seat locks guarding the rows of a reservation.
+static uint64_t reservation_stripes(struct Event* event, size_t num_seats, size_t* seats) {
+  uint64_t stripes = 0;
+
+  for (size_t i = 0; i < num_seats; i++) {
+    stripes |= row_stripe(event, seats[i] / event->cols + 1);
+  }
+
+  return stripes;
+}
+
+/// Claims the seats of a reservation by locking the seat locks of their rows.
+/// @param event Event of the reservation.
+/// @param num_seats Number of seats.
+/// @param seats Indexes of the seats.
+/// @param seat_ptrs Reservation ID of each seat.
+/// @return 0 if every seat is free and left locked, 1 if one is already
+/// reserved, in which case no lock is left held.
+static int claim_seats(struct Event* event, size_t num_seats, size_t* seats, atomic_uint** seat_ptrs) {
+  uint64_t stripes = reservation_stripes(event, num_seats, seats);
+
+  lock_stripes(event, stripes);
+
+  for (size_t i = 0; i < num_seats; i++) {
+    if (atomic_load_explicit(seat_ptrs[i], memory_order_relaxed) != 0) {
+      unlock_stripes(event, stripes);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/// Gives each claimed seat its reservation ID and unlocks the seat locks of their rows.
+/// @param event Event of the reservation.
+/// @param num_seats Number of seats.
+/// @param seats Indexes of the seats.
+/// @param seat_ptrs Reservation ID of each seat.
+/// @param reservation_id Reservation ID of the seats.
+static void release_seats(struct Event* event, size_t num_seats, size_t* seats, atomic_uint** seat_ptrs,
+                          unsigned int reservation_id) {
+  for (size_t j = 0; j < num_seats; j++) {
+    atomic_store_explicit(seat_ptrs[j], reservation_id, memory_order_relaxed);
+  }
+
+  unlock_stripes(event, reservation_stripes(event, num_seats, seats));
+}
+
+#endif
+
+/// Builds a new event with every seat free.
+/// @param event_id Id of the event.
+/// @param num_rows Number of rows of the event.
+/// @param num_cols Number of columns of the event.
+/// @return Newly created event, NULL on failure.
+static struct Event* new_event(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  struct Event* event = malloc(sizeof(struct Event));
+
+  if (event == NULL) {
+    fprintf(stderr, "Error allocating memory for event\n");
+    return NULL;
+  }
+
+  event->id = event_id;
+  event->sequence = 0;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  atomic_init(&event->reservations, 0);
+  atomic_init(&event->version, 0);
+  event->data = malloc(num_rows * num_cols * sizeof(atomic_uint));
+
+  if (event->data == NULL) {
+    free(event);
+    
+    fprintf(stderr, "Error allocating memory for event data\n");
+    return NULL;
+  }
+
+  // Initialize event
+  for (size_t i = 0; i < num_rows * num_cols; i++) {
+    atomic_init(&event->data[i], 0);
+  }
+
+  event->occupied = create_bitmap(num_rows * num_cols);
+
+  if (event->occupied == NULL) {
+    free(event->data);
+    free(event);
+
+    fprintf(stderr, "Error allocating memory for event data\n");
+    return NULL;
+  }
+
+#if !LOCK_FREE_RESERVE
+  event->num_seat_locks = num_rows < SEAT_LOCK_STRIPES ? (num_rows > 0 ? num_rows : 1) : SEAT_LOCK_STRIPES;
+  event->seat_locks = malloc(event->num_seat_locks * sizeof(pthread_mutex_t));
+
+  if (event->seat_locks == NULL) {
+    free(event->occupied);
+    free(event->data);
+    free(event);
+
+    fprintf(stderr, "Error allocating memory for event data\n");
+    return NULL;
+  }
+
+  for (size_t i = 0; i < event->num_seat_locks; i++) {
+    if(pthread_mutex_init(&event->seat_locks[i], NULL) != 0){
+      fprintf(stderr, "Failed to initialize mutex\n");
+      exit(1);
+    }
+  }
+#endif
+
+  if(pthread_mutex_init(&event->snapshot_lock, NULL) != 0){
+    fprintf(stderr, "Failed to initialize mutex\n");
+    exit(1);
+  }
+
+  event->published = NULL;
+  atomic_init(&event->unpublished, 0);
+
+  // Every seat of a row starts free, in a single run
+  atomic_init(&event->reserved, 0);
+  event->row_free = malloc((num_rows > 0 ? num_rows : 1) * sizeof(atomic_size_t));
+  event->row_run = malloc((num_rows > 0 ? num_rows : 1) * sizeof(atomic_size_t));
+
+  if (event->row_free == NULL || event->row_run == NULL) {
+    free_event(event);
+
+    fprintf(stderr, "Error allocating memory for event data\n");
+    return NULL;
+  }
+
+  for (size_t i = 0; i < num_rows; i++) {
+    atomic_init(&event->row_free[i], num_cols);
+    atomic_init(&event->row_run[i], num_cols);
+  }
+
+  // Every seat starts free, so the first snapshot is all zeros
+  if (snapshot_interval > 0) {
+    event->published = calloc(1, sizeof(struct SeatSnapshot) + num_rows * num_cols * sizeof(unsigned int));
+
+    if (event->published == NULL) {
+      free_event(event);
+
+      fprintf(stderr, "Error allocating memory for event data\n");
+      return NULL;
+    }
+
+    atomic_init(&event->published->refs, 1);
+  }
+
+  return event;
+}
+
+/// Updates the occupancy counters of an event once a reservation committed.
+/// @param event Event of the reservation.
+/// @param num_seats Number of seats.
+/// @param seats Sorted indexes of the seats, already set in the occupied bitmap.
+static void count_reserved_seats(struct Event* event, size_t num_seats, size_t* seats) {
+  atomic_fetch_add_explicit(&event->reserved, num_seats, memory_order_relaxed);
+
+  size_t i = 0;
+
+  while (i < num_seats) {
+    size_t row = seats[i] / event->cols;
+    size_t first = i;
+
+    for (; i < num_seats && seats[i] / event->cols == row; i++);
+
+    atomic_fetch_sub_explicit(&event->row_free[row], i - first, memory_order_relaxed);
+
+    // Runs only ever shrink, so the smallest one measured is the current one,
+    // whichever order concurrent reservations of the row get here in
+    size_t run = longest_clear_run(event->occupied, row * event->cols, event->cols);
+    size_t current = atomic_load(&event->row_run[row]);
+
+    while (run < current && !atomic_compare_exchange_weak(&event->row_run[row], &current, run));
+  }
+}
+
+/// Reserves seats of an event.
+/// @param event Event of the reservation.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param exclusive 1 if only the calling thread ever touches the event, so
+/// seats can be written without claiming them first.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, int exclusive) {
+  // Sort reservation seats
+  if(sort(xs, ys, num_seats) < 0){
+    fprintf(stderr, "Invalid reservation\n");
+    return 1;
+  }
+  
+  size_t seats[num_seats];
+
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Invalid seat\n");
+      return 1;
+    }
+
+    seats[i] = seat_index(event, xs[i], ys[i]);
+  }
+
+  // Reject reservations that conflict with committed ones before claiming any seat
+  if (any_bit_set(event->occupied, seats, num_seats)) {
+    fprintf(stderr, "Seat already reserved\n");
+    return 1;
+  }
+
+  // Fetch the seats once for each row they are on
+  atomic_uint* seat_ptrs[num_seats];
+  get_seats_with_delay(event, num_seats, seats, seat_ptrs);
+
+  if (exclusive) {
+    // Nobody else can take the seats, the bitmap check was enough
+    unsigned int reservation_id = atomic_load_explicit(&event->reservations, memory_order_relaxed) + 1;
+    atomic_store_explicit(&event->reservations, reservation_id, memory_order_relaxed);
+
+    for (size_t i = 0; i < num_seats; i++) {
+      atomic_store_explicit(seat_ptrs[i], reservation_id, memory_order_relaxed);
+    }
+
+    set_bits(event->occupied, seats, num_seats);
+    count_reserved_seats(event, num_seats, seats);
+
+    return 0;
+  }
+
+  begin_commit(event);
+
+  // Claim the seats in sorted order, so concurrent reservations can't deadlock
+#if LOCK_FREE_RESERVE
+  int claim_ret = claim_seats(num_seats, seat_ptrs);
+#else
+  int claim_ret = claim_seats(event, num_seats, seats, seat_ptrs);
+#endif
+
+  if (claim_ret != 0) {
+    abort_commit(event);
+
+    fprintf(stderr, "Seat already reserved\n");
+    return 1;
+  }
+
+  // If all seats are claimed, get a new reservation ID for the event...
+  unsigned int reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+
+  // ... and give it to each seat
+#if LOCK_FREE_RESERVE
+  release_seats(num_seats, seat_ptrs, reservation_id);
+#else
+  release_seats(event, num_seats, seats, seat_ptrs, reservation_id);
+#endif
+
+  end_commit(event);
+
+  set_bits(event->occupied, seats, num_seats);
+  count_reserved_seats(event, num_seats, seats);
+
+  unsigned int unpublished = atomic_fetch_add_explicit(&event->unpublished, 1, memory_order_relaxed) + 1;
+
+  // Try to publish every reservation once the published snapshot is an interval
+  // behind. Copies overlapping a commit give up, so after another interval of
+  // them the copy waits instead, and the published snapshot never falls more
+  // than about twice the interval behind.
+  if (snapshot_interval > 0 && unpublished >= snapshot_interval) {
+    atomic_uint** rows = reserve_rows(event);
+
+    if (rows != NULL || event->rows == 0) {
+      get_rows_with_delay(event, rows);
+
+      struct SeatSnapshot* fresh = publish_snapshot(event, rows, unpublished - snapshot_interval >= snapshot_interval);
+
+      if (fresh != NULL) {
+        release_snapshot(fresh);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/// Gets a snapshot of the seats of an event for SHOW without waiting for
+/// reservations in progress. The published snapshot is used when it is up to
+/// date or reservations are committing right now, a fresh one is copied and
+/// published otherwise.
+/// @param event Event with snapshots enabled.
+/// @return Snapshot to be released with release_snapshot.
+static struct SeatSnapshot* read_snapshot(struct Event* event) {
+  struct SeatSnapshot* published = acquire_snapshot(event);
+  uint64_t version = atomic_load_explicit(&event->version, memory_order_acquire);
+
+  if (published->version >> 32 == version >> 32 || (version & UINT32_MAX) != 0) {
+    return published;
+  }
+
+  atomic_uint** rows = reserve_rows(event);
+
+  if (rows == NULL && event->rows > 0) {
+    return published;
+  }
+
+  get_rows_with_delay(event, rows);
+
+  struct SeatSnapshot* fresh = publish_snapshot(event, rows, 0);
+
+  if (fresh == NULL) {
+    return published;
+  }
+
+  release_snapshot(published);
+  return fresh;
+}
+
+/// Prints an event as a single block of output.
+/// @param event Event to print.
+/// @param out Writer of the output file.
+/// @param exclusive 1 if only the calling thread ever touches the event, so
+/// seats can be read without watching for reservations in progress.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int show_event(struct Event* event, struct OutputWriter* out, int exclusive) {
+  struct SeatSnapshot* shared = NULL;
+  unsigned int* seats;
+
+  if (!exclusive && snapshot_interval > 0) {
+    shared = read_snapshot(event);
+    seats = shared->seats;
+  }
+  else {
+    size_t num_seats = event->rows * event->cols;
+    atomic_uint** rows = reserve_rows(event);
+
+    if (rows == NULL && event->rows > 0) {
+      fprintf(stderr, "Error allocating memory for output\n");
+      return 1;
+    }
+
+    if (snapshot_capacity < num_seats) {
+      unsigned int* values = realloc(snapshot, num_seats * sizeof(unsigned int));
+
+      if (values == NULL) {
+        fprintf(stderr, "Error allocating memory for output\n");
+        return 1;
+      }
+
+      snapshot = values;
+      snapshot_capacity = num_seats;
+    }
+
+    // Fetch every row once, so retrying the copy doesn't access the state again
+    get_rows_with_delay(event, rows);
+
+    if (exclusive) {
+      for (size_t i = 0; i < event->rows; i++) {
+        for (size_t j = 0; j < event->cols; j++) {
+          snapshot[i * event->cols + j] = atomic_load_explicit(&rows[i][j], memory_order_relaxed);
+        }
+      }
+    }
+    else {
+      copy_seats(event, rows);
+    }
+
+    seats = snapshot;
+  }
+
+  // Render the whole event first, so it reaches the file as one block
+  struct OutputBuffer* buffer = &output_buffer;
+  buffer->len = 0;
+  int ret = 0;
+
+  for (size_t i = 0; i < event->rows; i++) {
+    // Each seat takes at most MAX_UINT_DIGITS digits and a separator
+    if (reserve_output(buffer, event->cols * (MAX_UINT_DIGITS + 1) + 1) != 0) {
+      fprintf(stderr, "Error allocating memory for output\n");
+      ret = 1;
+      break;
+    }
+
+    buffer->len += format_uint_row(seats + i * event->cols, event->cols, buffer->data + buffer->len);
+    buffer->data[buffer->len++] = '\n';
+  }
+
+  if (shared != NULL) {
+    release_snapshot(shared);
+  }
+
+  if (ret == 0 && submit_output(out, buffer)) {
+    fprintf(stderr, "Error while writing to file.\n");
+    ret = 1;
+  }
+  
+  return ret;
+}
+
+/// Appends a string to a buffer with room for it.
+/// @param buffer Buffer to append to.
+/// @param text String to be appended.
+static void append_text(struct OutputBuffer* buffer, const char* text) {
+  size_t len = strlen(text);
+  memcpy(buffer->data + buffer->len, text, len);
+  buffer->len += len;
+}
+
+/// Prints the occupancy counters of an event, without reading its seats.
+/// @param event Event to print the counters of.
+/// @param out Writer of the output file.
+/// @return 0 if the counters were printed successfully, 1 otherwise.
+static int stats_event(struct Event* event, struct OutputWriter* out) {
+  struct OutputBuffer* buffer = &output_buffer;
+  buffer->len = 0;
+
+  // Every line holds at most three numbers of MAX_UINT_DIGITS digits and some text
+  size_t line_size = 3 * MAX_UINT_DIGITS + 32;
+
+  if (reserve_output(buffer, (event->rows + 1) * line_size) != 0) {
+    fprintf(stderr, "Error allocating memory for output\n");
+    return 1;
+  }
+
+  size_t reserved = atomic_load_explicit(&event->reserved, memory_order_relaxed);
+
+  append_text(buffer, "Event ");
+  buffer->len += format_uint(event->id, buffer->data + buffer->len);
+  append_text(buffer, ": ");
+  buffer->len += format_uint((unsigned int)reserved, buffer->data + buffer->len);
+  append_text(buffer, " reserved, ");
+  buffer->len += format_uint((unsigned int)(event->rows * event->cols - reserved), buffer->data + buffer->len);
+  append_text(buffer, " free\n");
+
+  for (size_t i = 0; i < event->rows; i++) {
+    append_text(buffer, "Row ");
+    buffer->len += format_uint((unsigned int)(i + 1), buffer->data + buffer->len);
+    append_text(buffer, ": ");
+    buffer->len += format_uint((unsigned int)atomic_load_explicit(&event->row_free[i], memory_order_relaxed),
+                               buffer->data + buffer->len);
+    append_text(buffer, " free, longest run ");
+    buffer->len += format_uint((unsigned int)atomic_load_explicit(&event->row_run[i], memory_order_relaxed),
+                               buffer->data + buffer->len);
+    buffer->data[buffer->len++] = '\n';
+  }
+
+  if (submit_output(out, buffer)) {
+    fprintf(stderr, "Error while writing to file.\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+/// Appends an "Event: <id>" line for every event of a list to a buffer.
+/// @param list Event list to be rendered.
+/// @param buffer Buffer to append the lines to.
+/// @param sequences Where to store the creation sequence number of the event of
+/// each line, with room for every event of the list, NULL if not needed.
+/// @return 0 if every line was rendered, 1 if memory ran out.
+static int render_events(struct EventList* list, struct OutputBuffer* buffer, size_t* sequences) {
+  size_t i = 0;
+
+  for (struct ListNode* current = list->head; current != NULL; current = current->next) {
+    if (sequences != NULL) {
+      sequences[i++] = current->event->sequence;
+    }
+
+    if (reserve_output(buffer, strlen("Event: ") + MAX_UINT_DIGITS + 1) != 0) {
+      return 1;
+    }
+
+    memcpy(buffer->data + buffer->len, "Event: ", strlen("Event: "));
+    buffer->len += strlen("Event: ");
+    buffer->len += format_uint((current->event)->id, buffer->data + buffer->len);
+    buffer->data[buffer->len++] = '\n';
+  }
+
+  return 0;
+}
+
+/// Hands a rendered list of events to the writer, or "No events" if it is empty.
+/// @param buffer Buffer with the rendered list.
+/// @param out Writer of the output file.
+/// @return 0 if the list was printed successfully, 1 otherwise.
+static int submit_events(struct OutputBuffer* buffer, struct OutputWriter* out) {
+  if (buffer->len == 0) {
+    if (reserve_output(buffer, strlen("No events\n")) != 0) {
+      fprintf(stderr, "Error allocating memory for output\n");
+      return 1;
+    }
+
+    memcpy(buffer->data, "No events\n", strlen("No events\n"));
+    buffer->len = strlen("No events\n");
+  }
+
+  if (submit_output(out, buffer)) {
+    fprintf(stderr, "Error while writing to file.\n");
+    return 1;
+  }
 
-/// Gets the index of a seat.
-/// @note This function assumes that the seat exists.
-/// @param event Event to get the seat index from.
-/// @param row Row of the seat.
-/// @param col Column of the seat.
-/// @return Index of the seat.
-static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
+  return 0;
+}
 
 int ems_init(unsigned int delay_ms) {
   if (event_list != NULL) {
@@ -59,6 +972,8 @@ int ems_init(unsigned int delay_ms) {
 
   event_list = create_list();
   state_access_delay_ms = delay_ms;
+  atomic_store(&cache_hits, 0);
+  atomic_store(&cache_misses, 0);
 
   return event_list == NULL;
 }
@@ -69,410 +984,325 @@ int ems_terminate() {
     return 1;
   }
 
+  invalidate_event_caches();
   free_list(event_list);
+  event_list = NULL;
   return 0;
 }
 
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  if(pthread_mutex_lock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
-    exit(1);
-  }
+  struct EventList* list = current_state();
 
-  if (event_list == NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to lock mutex\n");
-      exit(1);
-    }
-    
+  if (list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id) != NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-
-    fprintf(stderr, "Event already exists\n");
-    return 1;
-  }
-
-  struct Event* event = malloc(sizeof(struct Event));
+  // Build the event before taking the writer lock, so readers are only blocked
+  // while it is being looked up and appended
+  struct Event* event = new_event(event_id, num_rows, num_cols);
 
   if (event == NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
-    fprintf(stderr, "Error allocating memory for event\n");
     return 1;
   }
 
-  // Initialize event
-  if(pthread_mutex_init(&event->event_lock, NULL) != 0){
-    fprintf(stderr, "Failed to initialize mutex\n");
+  if(pthread_rwlock_wrlock(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to lock rwlock\n");
     exit(1);
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  event->data = malloc(num_rows * num_cols * sizeof(struct Seat));
+  int exists = get_event_with_delay(list, event_id) != NULL;
 
-  if (event->data == NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
+  if (exists || append_to_list(list, event) != 0) {
+    if(pthread_rwlock_unlock(&list->event_list_lock) != 0){
+      fprintf(stderr, "Failed to unlock rwlock\n");
       exit(1);
     }
-    
-    free(event);
-    
-    fprintf(stderr, "Error allocating memory for event data\n");
-    return 1;
-  }
-
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    event->data[i].reservation_id = 0;
-  }
 
-  if (append_to_list(event_list, event) != 0) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
-    free(event->data);
-    free(event);
+    free_event(event);
     
-    fprintf(stderr, "Error appending event to list\n");
+    fprintf(stderr, exists ? "Event already exists\n" : "Error appending event to list\n");
     return 1;
   }
   
-  if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
+  if(pthread_rwlock_unlock(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to unlock rwlock\n");
     exit(1);
   }
 
+  cache_event(list, event);
+
   return 0;
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  if(pthread_mutex_lock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
-    exit(1);
-  }
-  
-  if (event_list == NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
+  struct EventList* list = current_state();
+
+  if (list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id);
-  
-  if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
-    exit(1);
-  }
+  struct Event* event = find_event(list, event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  // Sort reservation seats
-  if(sort(xs, ys, num_seats) < 0){
-    fprintf(stderr, "Invalid reservation\n");
+  return reserve_seats(event, num_seats, xs, ys, 0);
+}
+
+int ems_show(unsigned int event_id, struct OutputWriter* out) {
+  struct EventList* list = current_state();
+
+  if (list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
-  
-  // Check if reservation is successful, locking each seat
-  size_t i = 0;
-  for (; i < num_seats; i++) {
-    size_t row = xs[i];
-    size_t col = ys[i];
 
-    if (row <= 0 || row > event->rows || col <= 0 || col > event->cols) {
-      fprintf(stderr, "Invalid seat\n");
-      i--;
-      break;
-    }
+  struct Event* event = find_event(list, event_id);
 
-    struct Seat *seat = get_seat_with_delay(event, seat_index(event, row, col));
-    
-    if(pthread_mutex_lock(&seat->seat_lock) != 0){
-      fprintf(stderr, "Failed to lock mutex\n");
-      exit(1);
-    }
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
 
-    // If it's already reserved break
-    if (seat->reservation_id != 0) {
-      fprintf(stderr, "Seat already reserved\n");
-      break;
-    }
+  return show_event(event, out, 0);
+}
+
+int ems_stats(unsigned int event_id, struct OutputWriter* out) {
+  struct EventList* list = current_state();
+
+  if (list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
   }
 
-  // First seat is invalid
-  if((int) i < 0) return 1;
+  struct Event* event = find_event(list, event_id);
 
-  // If one of the seats is invalid or already reserved, unlock previous seats
-  if (i < num_seats) {
-    for (size_t j = 0; j <= i; j++) {
-      if(pthread_mutex_unlock(&(get_seat_with_delay(event, seat_index(event, xs[j], ys[j]))->seat_lock)) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-    }
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  // If all seats are valid, change number of reservations of the event...
-  if(pthread_mutex_lock(&event->event_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
+  return stats_event(event, out);
+}
+
+int ems_list_events(struct OutputWriter* out) {
+  struct EventList* list = current_state();
+
+  if (list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  struct OutputBuffer* buffer = &output_buffer;
+  buffer->len = 0;
+
+  if(pthread_rwlock_rdlock(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to lock rwlock\n");
     exit(1);
   }
 
-  unsigned int reservation_id = ++event->reservations;
-  
-  if(pthread_mutex_unlock(&event->event_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
+  // Render every event while the list can't change
+  int alloc_ret = render_events(list, buffer, NULL);
+
+  if(pthread_rwlock_unlock(&list->event_list_lock) != 0){
+    fprintf(stderr, "Failed to unlock rwlock\n");
     exit(1);
   }
 
-  for (size_t j = 0; j < num_seats; j++) {
-    struct Seat *seat = get_seat_with_delay(event, seat_index(event, xs[j], ys[j]));
-    
-    // ... change the reservation ID of each seat ...
-    seat->reservation_id = reservation_id;
-    
-    // ... and unlock it
-    if(pthread_mutex_unlock(&seat->seat_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
+  if (alloc_ret != 0) {
+    fprintf(stderr, "Error allocating memory for output\n");
+    return 1;
   }
 
-  return 0;
+  return submit_events(buffer, out);
 }
 
-int ems_show(unsigned int event_id, int fdout) {
-  if(pthread_mutex_lock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
-    exit(1);
+struct EventList* ems_create_state() { return create_list(); }
+
+void ems_free_state(struct EventList* state) {
+  invalidate_event_caches();
+  free_list(state);
+}
+
+void ems_use_state(struct EventList* state) { bound_state = state; }
+
+struct EventList* ems_create_shard() { return create_list(); }
+
+void ems_free_shard(struct EventList* shard) {
+  invalidate_event_caches();
+  free_list(shard);
+}
+
+int ems_shard_create(struct EventList* shard, unsigned int event_id, size_t num_rows, size_t num_cols,
+                     size_t sequence) {
+  if (get_event_with_delay(shard, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    return 1;
   }
-  
-  if (event_list == NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
-    fprintf(stderr, "EMS state must be initialized\n");
+
+  struct Event* event = new_event(event_id, num_rows, num_cols);
+
+  if (event == NULL) {
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id);
-  
-  if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
-    exit(1);
+  event->sequence = sequence;
+
+  if (append_to_list(shard, event) != 0) {
+    free_event(event);
+
+    fprintf(stderr, "Error appending event to list\n");
+    return 1;
   }
 
+  cache_event(shard, event);
+
+  return 0;
+}
+
+int ems_shard_reserve(struct EventList* shard, unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  struct Event* event = find_shard_event(shard, event_id);
+
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
     return 1;
   }
 
-  char buffer[32];
+  return reserve_seats(event, num_seats, xs, ys, 1);
+}
 
-  if(pthread_mutex_lock(&write_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
-    exit(1);
+int ems_shard_show(struct EventList* shard, unsigned int event_id, struct OutputWriter* out) {
+  struct Event* event = find_shard_event(shard, event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
   }
-  
-  // Lock each seat, print it's reservation ID and unlock it
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      struct Seat* seat = get_seat_with_delay(event, seat_index(event, i, j));
-
-      if(pthread_mutex_lock(&seat->seat_lock) != 0){
-        fprintf(stderr, "Failed to lock mutex\n");
-        exit(1);
-      }
 
-      sprintf(buffer, "%u", seat->reservation_id);
-      
-      if(write_to_file(fdout, buffer)){
-        if(pthread_mutex_unlock(&seat->seat_lock) != 0){
-          fprintf(stderr, "Failed to unlock mutex\n");
-          exit(1);
-        }
-        
-        fprintf(stderr, "Error while writing to file.\n");
-        return 1;
-      }
+  return show_event(event, out, 1);
+}
 
-      if (j < event->cols) {
-        if(write_to_file(fdout, " ")){
-          if(pthread_mutex_unlock(&seat->seat_lock) != 0){
-            fprintf(stderr, "Failed to unlock mutex\n");
-            exit(1);
-          }
-          
-          fprintf(stderr, "Error while writing to file.\n");
-          return 1;
-        }
-      }
+int ems_shard_stats(struct EventList* shard, unsigned int event_id, struct OutputWriter* out) {
+  struct Event* event = find_shard_event(shard, event_id);
 
-      if(pthread_mutex_unlock(&seat->seat_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-    }
-    
-    if(write_to_file(fdout, "\n")){
-      fprintf(stderr, "Error while writing to file.\n");
-      return 1;
-    }
-  }
-  
-  if(pthread_mutex_unlock(&write_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
-    exit(1);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
   }
-  
-  return 0;
+
+  return stats_event(event, out);
 }
 
-int ems_list_events(int fdout) {
-  if(pthread_mutex_lock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
-    exit(1);
+struct ListGather* ems_create_gather(size_t num_shards) {
+  struct ListGather* gather = malloc(sizeof(struct ListGather));
+
+  if (gather == NULL) return NULL;
+
+  gather->parts = calloc(num_shards, sizeof(struct ListPart));
+
+  if (gather->parts == NULL) {
+    free(gather);
+    return NULL;
   }
-  
-  if (event_list == NULL) {
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
-    fprintf(stderr, "EMS state must be initialized\n");
-    return 1;
+
+  gather->num_parts = num_shards;
+  atomic_init(&gather->remaining, num_shards);
+  atomic_init(&gather->failed, 0);
+
+  return gather;
+}
+
+int ems_shard_list_events(struct EventList* shard, size_t shard_index, struct ListGather* gather,
+                          struct OutputWriter* out) {
+  struct ListPart* part = &gather->parts[shard_index];
+  part->count = shard->size;
+  part->sequences = malloc((part->count > 0 ? part->count : 1) * sizeof(size_t));
+
+  if (part->sequences == NULL || render_events(shard, &part->lines, part->sequences) != 0) {
+    fprintf(stderr, "Error allocating memory for output\n");
+    atomic_store(&gather->failed, 1);
   }
 
-  if (event_list->head == NULL) {
-    if(pthread_mutex_lock(&write_lock) != 0){
-      fprintf(stderr, "Failed to lock mutex\n");
-      exit(1);
-    }
-    
-    if(write_to_file(fdout, "No events\n")){
-      if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-      
-      if(pthread_mutex_unlock(&write_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-      
-      fprintf(stderr, "Error while writing to file.\n");
-      return 1;
-    }
-    
-    if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
-    if(pthread_mutex_unlock(&write_lock) != 0){
-      fprintf(stderr, "Failed to unlock mutex\n");
-      exit(1);
-    }
-    
+  // The last shard to render its part merges them all and writes the list
+  if (atomic_fetch_sub(&gather->remaining, 1) != 1) {
     return 0;
   }
 
-  char buffer[16];
+  struct OutputBuffer* buffer = &output_buffer;
+  buffer->len = 0;
 
-  if(pthread_mutex_lock(&write_lock) != 0){
-    fprintf(stderr, "Failed to lock mutex\n");
-    exit(1);
+  int ret = atomic_load(&gather->failed);
+  size_t total = 0;
+
+  for (size_t i = 0; i < gather->num_parts; i++) {
+    total += gather->parts[i].lines.len;
   }
-  
-  struct ListNode* current = event_list->head;
-  
-  while (current != NULL) {
-    if(write_to_file(fdout, "Event: ")){
-      if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
 
-      if(pthread_mutex_unlock(&write_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-      
-      fprintf(stderr, "Error while writing to file.\n");
-      return 1;
-    }
+  if (ret == 0 && reserve_output(buffer, total) != 0) {
+    fprintf(stderr, "Error allocating memory for output\n");
+    ret = 1;
+  }
 
-    sprintf(buffer, "%u", (current->event)->id);
+  // Each part is already in creation order, so take the earliest next line of any part
+  size_t next[gather->num_parts];    // Next line of each part
+  size_t offset[gather->num_parts];  // Offset of the next line of each part
 
-    if(write_to_file(fdout, buffer)){
-      if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
+  for (size_t i = 0; i < gather->num_parts; i++) {
+    next[i] = 0;
+    offset[i] = 0;
+  }
 
-      if(pthread_mutex_unlock(&write_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
-      
-      fprintf(stderr, "Error while writing to file.\n");
-      return 1;
-    }
+  while (ret == 0) {
+    size_t earliest = gather->num_parts;
 
-    if(write_to_file(fdout, "\n")){
-      if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
-      }
+    for (size_t i = 0; i < gather->num_parts; i++) {
+      struct ListPart* candidate = &gather->parts[i];
 
-      if(pthread_mutex_unlock(&write_lock) != 0){
-        fprintf(stderr, "Failed to unlock mutex\n");
-        exit(1);
+      if (next[i] < candidate->count &&
+          (earliest == gather->num_parts ||
+           candidate->sequences[next[i]] < gather->parts[earliest].sequences[next[earliest]])) {
+        earliest = i;
       }
-      
-      fprintf(stderr, "Error while writing to file.\n");
-      return 1;
     }
 
-    current = current->next;
+    if (earliest == gather->num_parts) {
+      break;
+    }
+
+    struct OutputBuffer* lines = &gather->parts[earliest].lines;
+    char* start = lines->data + offset[earliest];
+    size_t len = (size_t)((char*)memchr(start, '\n', lines->len - offset[earliest]) - start) + 1;
+
+    memcpy(buffer->data + buffer->len, start, len);
+    buffer->len += len;
+    offset[earliest] += len;
+    next[earliest]++;
   }
-  
-  if(pthread_mutex_unlock(&event_list->event_list_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
-    exit(1);
+
+  if (ret == 0) {
+    ret = submit_events(buffer, out);
   }
-  
-  if(pthread_mutex_unlock(&write_lock) != 0){
-    fprintf(stderr, "Failed to unlock mutex\n");
-    exit(1);
+
+  for (size_t i = 0; i < gather->num_parts; i++) {
+    free(gather->parts[i].lines.data);
+    free(gather->parts[i].sequences);
   }
 
-  return 0;
+  free(gather->parts);
+  free(gather);
+
+  return ret;
+}
+
+void ems_set_snapshot_interval(unsigned int reservations) { snapshot_interval = reservations; }
+
+void ems_event_cache_stats(size_t* hits, size_t* misses) {
+  *hits = atomic_load(&cache_hits);
+  *misses = atomic_load(&cache_misses);
 }
 
 void ems_wait(unsigned int delay_ms) {
@@ -1,14 +1,17 @@
 #ifndef EMS_OPERATIONS_H
 #define EMS_OPERATIONS_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 
+#include "writer.h"
+
 /// Initializes the EMS state.
 /// @param delay_ms State access delay in milliseconds.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
 int ems_init(unsigned int delay_ms);
 
-/// Destroys the EMS state.
+/// Destroys the EMS state, after which ems_init may be called again.
 int ems_terminate();
 
 /// Creates a new event with the given id and dimensions.
@@ -28,12 +31,112 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys)
 
 /// Prints the given event.
 /// @param event_id Id of the event to print.
+/// @param out Writer of the output file.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(unsigned int event_id, int fdout);
+int ems_show(unsigned int event_id, struct OutputWriter *out);
+
+/// Prints how many seats of the given event are reserved and free, and the
+/// free seats and longest run of free seats of each row, from counters kept up
+/// to date by every reservation instead of reading the seats.
+/// @param event_id Id of the event to print the counters of.
+/// @param out Writer of the output file.
+/// @return 0 if the counters were printed successfully, 1 otherwise.
+int ems_stats(unsigned int event_id, struct OutputWriter *out);
 
 /// Prints all the events.
+/// @param out Writer of the output file.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int fdout);
+int ems_list_events(struct OutputWriter *out);
+
+// Event list holding an EMS state, or owned by a single thread in sharded mode
+struct EventList;
+
+/// Creates an EMS state of its own, so several jobs files can run in one process.
+/// @return Newly created state, NULL on failure.
+struct EventList *ems_create_state();
+
+/// Frees an EMS state created with ems_create_state and its events.
+/// @param state State to be freed.
+void ems_free_state(struct EventList *state);
+
+/// Makes every following operation of the calling thread use the given state.
+/// @param state State created with ems_create_state, NULL to go back to the one of ems_init.
+void ems_use_state(struct EventList *state);
+
+// Events of a shard rendered for a LIST
+struct ListPart {
+  struct OutputBuffer lines;  // "Event: <id>" line of each event, in the order they were created
+  size_t *sequences;          // Creation sequence number of the event of each line
+  size_t count;               // Number of lines
+};
+
+// LIST in sharded mode, rendered part by part by every shard
+struct ListGather {
+  atomic_size_t remaining;  // Number of shards that haven't rendered their part yet
+  atomic_int failed;        // 1 if any shard failed to render its part
+  struct ListPart *parts;   // Events of each shard
+  size_t num_parts;         // Number of shards
+};
+
+/// Creates an empty shard. The events of a shard are only ever touched by the
+/// thread that owns it, so its commands take no locks.
+/// @return Newly created shard, NULL on failure.
+struct EventList *ems_create_shard();
+
+/// Frees a shard and its events.
+/// @param shard Shard to be freed.
+void ems_free_shard(struct EventList *shard);
+
+/// Creates a new event in a shard, like ems_create.
+/// @param shard Shard owned by the calling thread.
+/// @param sequence Order the CREATE was routed in, across every shard, by which LIST sorts the events.
+/// @return 0 if the event was created successfully, 1 otherwise.
+int ems_shard_create(struct EventList *shard, unsigned int event_id, size_t num_rows, size_t num_cols,
+                     size_t sequence);
+
+/// Creates a new reservation for an event of a shard, like ems_reserve.
+/// @param shard Shard owned by the calling thread.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_shard_reserve(struct EventList *shard, unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+
+/// Prints an event of a shard, like ems_show.
+/// @param shard Shard owned by the calling thread.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+int ems_shard_show(struct EventList *shard, unsigned int event_id, struct OutputWriter *out);
+
+/// Prints the occupancy counters of an event of a shard, like ems_stats.
+/// @param shard Shard owned by the calling thread.
+/// @return 0 if the counters were printed successfully, 1 otherwise.
+int ems_shard_stats(struct EventList *shard, unsigned int event_id, struct OutputWriter *out);
+
+/// Creates the gather of a LIST, to be handed to every shard.
+/// @param num_shards Number of shards.
+/// @return Newly created gather, NULL on failure.
+struct ListGather *ems_create_gather(size_t num_shards);
+
+/// Renders the events of a shard into its part of a LIST. The last shard to
+/// do so merges the parts in the order the events were created, prints the
+/// whole list and frees the gather.
+/// @param shard Shard owned by the calling thread.
+/// @param shard_index Index of the shard, from 0.
+/// @param gather Gather of the LIST.
+/// @param out Writer of the output file.
+/// @return 0 if the part was rendered (and the list printed) successfully, 1 otherwise.
+int ems_shard_list_events(struct EventList *shard, size_t shard_index, struct ListGather *gather,
+                          struct OutputWriter *out);
+
+/// Makes events publish a snapshot of their seats every given number of
+/// reservations, which SHOW prints instead of copying the seats itself, so it
+/// never waits for reservations in progress but may miss the latest ones.
+/// @note Must be called before any event is created.
+/// @param reservations Reservations between snapshots, 0 to disable snapshots.
+void ems_set_snapshot_interval(unsigned int reservations);
+
+/// Gets how many event lookups of RESERVE and SHOW were served by the event
+/// caches of the threads, and how many had to search the state, since ems_init.
+/// @param hits Where to store the number of lookups served by the caches.
+/// @param misses Where to store the number of lookups that searched the state.
+void ems_event_cache_stats(size_t *hits, size_t *misses);
 
 /// Waits for a given amount of time.
 /// @param delay_us Delay in milliseconds.
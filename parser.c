@@ -1,18 +1,42 @@
 #include "parser.h"
 
 #include <limits.h>
-#include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "constants.h"
+#include "numbers.h"
 
-static int read_uint(int fd, unsigned int *value, char *next) {
+static int read_uint(struct FileReader *reader, unsigned int *value, char *next) {
+  const char *data;
+  size_t available = peek_chars(reader, &data);
+
+  // The number and the character after it are already buffered: parse in place
+  uint64_t parsed;
+  size_t digits = parse_digits(data, available, &parsed);
+
+  if (digits < available) {
+    *next = data[digits];
+    skip_chars(reader, digits + 1);
+
+    if (digits > MAX_UINT_DIGITS || parsed > UINT_MAX) {
+      return 1;
+    }
+
+    *value = (unsigned int)parsed;
+    return 0;
+  }
+
+  // The number reaches the end of the buffer, read it one character at a time
   char buf[16];
 
-  int i = 0;
+  size_t i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    // Too many digits to fit in an unsigned int
+    if (i == sizeof(buf) - 1) {
+      return 1;
+    }
+
+    if (read_char(reader, buf + i) == 0) {
       *next = '\0';
       break;
     }
@@ -20,139 +44,151 @@ static int read_uint(int fd, unsigned int *value, char *next) {
     *next = buf[i];
 
     if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
       break;
     }
 
     i++;
   }
 
-  unsigned long ul = strtoul(buf, NULL, 10);
+  digits = parse_digits(buf, i, &parsed);
 
-  if (ul > UINT_MAX) {
+  if (digits > MAX_UINT_DIGITS || parsed > UINT_MAX) {
     return 1;
   }
 
-  *value = (unsigned int)ul;
+  *value = (unsigned int)parsed;
 
   return 0;
 }
 
-static void cleanup(int fd) {
+static void cleanup(struct FileReader *reader) {
   char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+  while (read_char(reader, &ch) == 1 && ch != '\n')
     ;
 }
 
-enum Command get_next(int fd) {
+enum Command get_next(struct FileReader *reader) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (read_char(reader, buf) != 1) {
     return EOC;
   }
 
   switch (buf[0]) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
-        cleanup(fd);
+      if (read_chars(reader, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_CREATE;
 
     case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
-        cleanup(fd);
+      if (read_chars(reader, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
-        cleanup(fd);
+      if (read_char(reader, buf + 1) != 1) {
+        return CMD_INVALID;
+      }
+
+      if (buf[1] == 'T') {
+        if (read_chars(reader, buf + 2, 4) != 4 || strncmp(buf, "STATS ", 6) != 0) {
+          cleanup(reader);
+          return CMD_INVALID;
+        }
+
+        return CMD_STATS;
+      }
+
+      if (read_chars(reader, buf + 2, 3) != 3 || strncmp(buf, "SHOW ", 5) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_SHOW;
 
     case 'L':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
-        cleanup(fd);
+      if (read_chars(reader, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (read_char(reader, buf + 4) != 0 && buf[4] != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_LIST_EVENTS;
 
     case 'B':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
-        cleanup(fd);
+      if (read_chars(reader, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
-        cleanup(fd);
+      if (read_char(reader, buf + 7) != 0 && buf[7] != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_BARRIER;
 
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        cleanup(fd);
+      if (read_chars(reader, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_WAIT;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-        cleanup(fd);
+      if (read_chars(reader, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (read_char(reader, buf + 4) != 0 && buf[4] != '\n') {
+        cleanup(reader);
         return CMD_INVALID;
       }
 
       return CMD_HELP;
 
     case '#':
-      cleanup(fd);
+      cleanup(reader);
       return CMD_EMPTY;
 
     case '\n':
       return CMD_EMPTY;
 
     default:
-      cleanup(fd);
+      cleanup(reader);
       return CMD_INVALID;
   }
 }
 
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
+int parse_create(struct FileReader *reader, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
 
   unsigned int u_num_rows;
-  if (read_uint(fd, &u_num_rows, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_rows, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
   *num_rows = (size_t)u_num_rows;
 
   unsigned int u_num_cols;
-  if (read_uint(fd, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
   *num_cols = (size_t)u_num_cols;
@@ -160,44 +196,44 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
+size_t parse_reserve(struct FileReader *reader, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1 || ch != '[') {
+    cleanup(reader);
     return 0;
   }
 
   size_t num_coords = 0;
   while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
+    if (read_char(reader, &ch) != 1 || ch != '(') {
+      cleanup(reader);
       return 0;
     }
 
     unsigned int x;
-    if (read_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
+    if (read_uint(reader, &x, &ch) != 0 || ch != ',') {
+      cleanup(reader);
       return 0;
     }
     xs[num_coords] = (size_t)x;
 
     unsigned int y;
-    if (read_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
+    if (read_uint(reader, &y, &ch) != 0 || ch != ')') {
+      cleanup(reader);
       return 0;
     }
     ys[num_coords] = (size_t)y;
 
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
+    if (read_char(reader, &ch) != 1 || (ch != ' ' && ch != ']')) {
+      cleanup(reader);
       return 0;
     }
 
@@ -207,45 +243,45 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
   }
 
   if (num_coords == max) {
-    cleanup(fd);
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 0;
   }
 
   return num_coords;
 }
 
-int parse_show(int fd, unsigned int *event_id) {
+int parse_show(struct FileReader *reader, unsigned int *event_id) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
 
   return 0;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_wait(struct FileReader *reader, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (read_uint(reader, delay, &ch) != 0) {
+    cleanup(reader);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (read_uint(reader, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(reader);
       return -1;
     }
     return 1;
@@ -254,7 +290,7 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
     return 0;
   } 
   else {
-    cleanup(fd);
+    cleanup(reader);
     return -1;
   }
 }
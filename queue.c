@@ -0,0 +1,108 @@
+#include "queue.h"
+
+#include <sched.h>
+#include <stdlib.h>
+
+struct SpscQueue *create_spsc_queues(size_t n) {
+  struct SpscQueue *queues = aligned_alloc(CACHE_LINE_SIZE, n * sizeof(struct SpscQueue));
+
+  if (queues == NULL) return NULL;
+
+  for (size_t i = 0; i < n; i++) {
+    atomic_init(&queues[i].head, 0);
+    atomic_init(&queues[i].tail, 0);
+  }
+
+  return queues;
+}
+
+void spsc_push(struct SpscQueue *queue, struct Task task) {
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == TASK_QUEUE_SIZE) {
+    sched_yield();
+  }
+
+  queue->tasks[tail & (TASK_QUEUE_SIZE - 1)] = task;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+struct Task spsc_pop(struct SpscQueue *queue) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+  while (atomic_load_explicit(&queue->tail, memory_order_acquire) == head) {
+    sched_yield();
+  }
+
+  struct Task task = queue->tasks[head & (TASK_QUEUE_SIZE - 1)];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+  return task;
+}
+
+struct MpmcQueue *create_mpmc_queue() {
+  struct MpmcQueue *queue = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct MpmcQueue));
+
+  if (queue == NULL) return NULL;
+
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+
+  for (size_t i = 0; i < TASK_QUEUE_SIZE; i++) {
+    atomic_init(&queue->cells[i].sequence, i);
+  }
+
+  return queue;
+}
+
+void mpmc_push(struct MpmcQueue *queue, struct Message message) {
+  size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  struct MpmcCell *cell;
+
+  while (1) {
+    cell = &queue->cells[pos & (TASK_QUEUE_SIZE - 1)];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+
+    if (sequence == pos) {
+      // The slot is free, take it unless another producer got there first
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else {
+      // The slot still holds a message from the previous lap while the queue is full
+      if (sequence < pos) sched_yield();
+      pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+
+  cell->message = message;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+}
+
+struct Message mpmc_pop(struct MpmcQueue *queue) {
+  size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  struct MpmcCell *cell;
+
+  while (1) {
+    cell = &queue->cells[pos & (TASK_QUEUE_SIZE - 1)];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+
+    if (sequence == pos + 1) {
+      // The slot holds a message, take it unless another consumer got there first
+      if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else {
+      // The slot hasn't been filled yet while the queue is empty
+      if (sequence < pos + 1) sched_yield();
+      pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    }
+  }
+
+  struct Message message = cell->message;
+  atomic_store_explicit(&cell->sequence, pos + TASK_QUEUE_SIZE, memory_order_release);
+
+  return message;
+}
@@ -0,0 +1,77 @@
+#ifndef EMS_QUEUE_H
+#define EMS_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "constants.h"
+#include "segment.h"
+
+#define CACHE_LINE_SIZE 64
+
+// Command handed to a worker thread
+struct Task {
+  struct Instruction *instruction;  // Command to execute, NULL to mark the end of the segment
+  void *context;                    // State shared by every thread the command was handed to
+  size_t sequence;                  // Order the event of a CREATE was routed in, across every shard
+};
+
+// Bounded queue of tasks with a single producer and a single consumer
+struct SpscQueue {
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t head;  // Number of tasks taken, written by the consumer
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;  // Number of tasks pushed, written by the producer
+
+  _Alignas(CACHE_LINE_SIZE) struct Task tasks[TASK_QUEUE_SIZE];
+};
+
+// Command travelling from the parser thread to the workers in streaming mode
+struct Message {
+  struct Instruction instruction;  // Decoded command, CMD_BARRIER and EOC are control messages
+  size_t *xs;                      // Rows of a RESERVE, freed by the worker that executes it
+  size_t *ys;                      // Columns of a RESERVE, in the same allocation as xs
+};
+
+// Slot of a multi producer queue, with the sequence number telling whose turn it is
+struct MpmcCell {
+  atomic_size_t sequence;  // Position that may push next if equal to it, pop if one more
+  struct Message message;
+};
+
+// Bounded lock-free queue of messages with any number of producers and consumers
+struct MpmcQueue {
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t head;  // Position of the next message to pop
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;  // Position of the next message to push
+
+  _Alignas(CACHE_LINE_SIZE) struct MpmcCell cells[TASK_QUEUE_SIZE];
+};
+
+/// Allocates an array of empty queues.
+/// @param n Number of queues.
+/// @return Newly created queues, NULL on failure.
+struct SpscQueue *create_spsc_queues(size_t n);
+
+/// Adds a task to a queue, yielding while it is full. Only one thread may push.
+/// @param queue Queue to be modified.
+/// @param task Task to add.
+void spsc_push(struct SpscQueue *queue, struct Task task);
+
+/// Takes the oldest task of a queue, yielding while it is empty. Only one thread may pop.
+/// @param queue Queue to be modified.
+/// @return Oldest task of the queue.
+struct Task spsc_pop(struct SpscQueue *queue);
+
+/// Allocates an empty multi producer, multi consumer queue.
+/// @return Newly created queue, NULL on failure.
+struct MpmcQueue *create_mpmc_queue();
+
+/// Adds a message to a queue, yielding while it is full.
+/// @param queue Queue to be modified.
+/// @param message Message to add.
+void mpmc_push(struct MpmcQueue *queue, struct Message message);
+
+/// Takes the oldest message of a queue, yielding while it is empty.
+/// @param queue Queue to be modified.
+/// @return Oldest message of the queue.
+struct Message mpmc_pop(struct MpmcQueue *queue);
+
+#endif  // EMS_QUEUE_H
@@ -0,0 +1,311 @@
+#include "segment.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "constants.h"
+
+#define NO_CHAIN SIZE_MAX  // Free slot of the event table used while scheduling
+
+// Chain of commands being placed, while scheduling a segment
+struct Chain {
+  size_t len;    // Number of commands
+  size_t first;  // Index of its first command
+  size_t id;     // Order in which it was found
+  size_t stage;  // Stage the chain runs in
+};
+
+/// Hashes an event ID into a slot of the event table.
+/// @param event_id Event ID.
+/// @param capacity Number of slots of the table, a power of two.
+/// @return Slot where the search for the event starts.
+static size_t event_slot(unsigned int event_id, size_t capacity) {
+  unsigned int h = event_id;
+  h ^= h >> 16;
+  h *= 0x45d9f3bU;
+  h ^= h >> 16;
+  return (size_t)h & (capacity - 1);
+}
+
+/// Orders chains by stage, then longest first, then by their first command.
+static int compare_chains(const void *a, const void *b) {
+  const struct Chain *x = (const struct Chain *)a;
+  const struct Chain *y = (const struct Chain *)b;
+
+  if (x->stage != y->stage) return x->stage < y->stage ? -1 : 1;
+  if (x->len != y->len) return x->len > y->len ? -1 : 1;
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+void init_segment(struct Segment *segment) {
+  segment->instructions = NULL;
+  segment->num_instructions = 0;
+  segment->capacity = 0;
+
+  segment->xs = NULL;
+  segment->ys = NULL;
+  segment->num_coords = 0;
+  segment->coords_capacity = 0;
+
+  segment->order = NULL;
+  segment->chain_starts = NULL;
+  segment->num_chains = 0;
+  segment->stage_ends = NULL;
+  segment->num_stages = 0;
+  segment->schedule_capacity = 0;
+
+  segment->end = EOC;
+}
+
+void free_segment(struct Segment *segment) {
+  free(segment->instructions);
+  free(segment->xs);
+  free(segment->ys);
+  free(segment->order);
+  free(segment->chain_starts);
+  free(segment->stage_ends);
+  init_segment(segment);
+}
+
+struct Instruction *new_instruction(struct Segment *segment) {
+  if (segment->num_instructions == segment->capacity) {
+    size_t capacity = segment->capacity == 0 ? 64 : segment->capacity * 2;
+    struct Instruction *instructions = realloc(segment->instructions, capacity * sizeof(struct Instruction));
+
+    if (instructions == NULL) return NULL;
+
+    segment->instructions = instructions;
+    segment->capacity = capacity;
+  }
+
+  struct Instruction *instruction = &segment->instructions[segment->num_instructions++];
+
+  instruction->event_id = 0;
+  instruction->arg1 = 0;
+  instruction->arg2 = 0;
+  instruction->coords = 0;
+  instruction->num_coords = 0;
+
+  return instruction;
+}
+
+int reserve_coords(struct Segment *segment) {
+  if (segment->coords_capacity - segment->num_coords >= MAX_RESERVATION_SIZE) return 0;
+
+  size_t capacity = segment->coords_capacity == 0 ? 4 * MAX_RESERVATION_SIZE : segment->coords_capacity * 2;
+
+  size_t *xs = realloc(segment->xs, capacity * sizeof(size_t));
+  if (xs == NULL) return 1;
+  segment->xs = xs;
+
+  size_t *ys = realloc(segment->ys, capacity * sizeof(size_t));
+  if (ys == NULL) return 1;
+  segment->ys = ys;
+
+  segment->coords_capacity = capacity;
+
+  return 0;
+}
+
+void parse_instruction(struct FileReader *reader, struct Instruction *instruction, size_t *xs, size_t *ys) {
+  enum Command cmd;
+
+  while ((cmd = get_next(reader)) == CMD_EMPTY) {
+  }
+
+  instruction->cmd = cmd;
+  instruction->event_id = 0;
+  instruction->arg1 = 0;
+  instruction->arg2 = 0;
+  instruction->coords = 0;
+  instruction->num_coords = 0;
+
+  switch (cmd) {
+    case CMD_CREATE: {
+      size_t num_rows, num_cols;
+
+      if (parse_create(reader, &instruction->event_id, &num_rows, &num_cols) != 0) {
+        instruction->cmd = CMD_INVALID;
+        break;
+      }
+
+      instruction->arg1 = (unsigned int)num_rows;
+      instruction->arg2 = (unsigned int)num_cols;
+      break;
+    }
+
+    case CMD_RESERVE:
+      instruction->num_coords = parse_reserve(reader, MAX_RESERVATION_SIZE, &instruction->event_id, xs, ys);
+
+      if (instruction->num_coords == 0) {
+        instruction->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_SHOW:
+    case CMD_STATS:
+      if (parse_show(reader, &instruction->event_id) != 0) {
+        instruction->cmd = CMD_INVALID;
+      }
+      break;
+
+    case CMD_WAIT: {
+      int wait_ret = parse_wait(reader, &instruction->arg1, &instruction->arg2);
+
+      // Thread IDs start at 1, so an explicit 0 is as invalid as a malformed WAIT
+      if (wait_ret == -1 || (wait_ret == 1 && instruction->arg2 == ALL_THREADS)) {
+        instruction->cmd = CMD_INVALID;
+      } else if (wait_ret == 0) {
+        instruction->arg2 = ALL_THREADS;
+      }
+      break;
+    }
+
+    case CMD_LIST_EVENTS:
+    case CMD_HELP:
+    case CMD_INVALID:
+    case CMD_BARRIER:
+    case CMD_EMPTY:
+    case EOC:
+      break;
+  }
+}
+
+int parse_segment(struct FileReader *reader, struct Segment *segment) {
+  segment->num_instructions = 0;
+  segment->num_coords = 0;
+  segment->num_chains = 0;
+  segment->num_stages = 0;
+
+  while (1) {
+    if (reserve_coords(segment) != 0) return 1;
+
+    struct Instruction parsed;
+    parse_instruction(reader, &parsed, segment->xs + segment->num_coords, segment->ys + segment->num_coords);
+
+    if (parsed.cmd == CMD_BARRIER || parsed.cmd == EOC) {
+      segment->end = parsed.cmd;
+      return 0;
+    }
+
+    struct Instruction *instruction = new_instruction(segment);
+    if (instruction == NULL) return 1;
+
+    *instruction = parsed;
+    instruction->coords = segment->num_coords;
+    segment->num_coords += parsed.num_coords;
+  }
+}
+
+int schedule_segment(struct Segment *segment) {
+  size_t n = segment->num_instructions;
+  segment->num_chains = 0;
+  segment->num_stages = 0;
+
+  if (n == 0) return 0;
+
+  if (segment->schedule_capacity < n) {
+    size_t *order = realloc(segment->order, n * sizeof(size_t));
+    if (order == NULL) return 1;
+    segment->order = order;
+
+    size_t *chain_starts = realloc(segment->chain_starts, (n + 1) * sizeof(size_t));
+    if (chain_starts == NULL) return 1;
+    segment->chain_starts = chain_starts;
+
+    size_t *stage_ends = realloc(segment->stage_ends, n * sizeof(size_t));
+    if (stage_ends == NULL) return 1;
+    segment->stage_ends = stage_ends;
+
+    segment->schedule_capacity = n;
+  }
+
+  size_t table_capacity = 16;
+  while (table_capacity < 2 * n) table_capacity *= 2;
+
+  size_t *chain_of = malloc(n * sizeof(size_t));
+  size_t *table = malloc(table_capacity * sizeof(size_t));
+  struct Chain *chains = malloc(n * sizeof(struct Chain));
+
+  if (chain_of == NULL || table == NULL || chains == NULL) {
+    free(chain_of);
+    free(table);
+    free(chains);
+    return 1;
+  }
+
+  for (size_t slot = 0; slot < table_capacity; slot++) table[slot] = NO_CHAIN;
+
+  // Find the chain of each command, the table maps event IDs to their latest chain
+  size_t num_chains = 0;
+  size_t stage = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    struct Instruction *instruction = &segment->instructions[i];
+    size_t chain = num_chains;
+
+    // Ordering points run alone, after every command before them and before every one after them
+    int ordering_point = instruction->cmd == CMD_LIST_EVENTS || instruction->cmd == CMD_WAIT;
+
+    if (ordering_point && i > 0) {
+      stage++;
+    }
+
+    if (instruction->cmd == CMD_CREATE || instruction->cmd == CMD_RESERVE || instruction->cmd == CMD_SHOW ||
+        instruction->cmd == CMD_STATS) {
+      size_t slot = event_slot(instruction->event_id, table_capacity);
+
+      while (table[slot] != NO_CHAIN && segment->instructions[chains[table[slot]].first].event_id != instruction->event_id) {
+        slot = (slot + 1) & (table_capacity - 1);
+      }
+
+      // The chain of the event in an earlier stage is left behind
+      if (table[slot] == NO_CHAIN || chains[table[slot]].stage != stage) {
+        table[slot] = num_chains;
+      } else {
+        chain = table[slot];
+      }
+    }
+
+    if (chain == num_chains) {
+      chains[num_chains] = (struct Chain){0, i, num_chains, stage};
+      num_chains++;
+    }
+
+    chains[chain].len++;
+    chain_of[i] = chain;
+
+    if (ordering_point && i + 1 < n) {
+      stage++;
+    }
+  }
+
+  qsort(chains, num_chains, sizeof(struct Chain), compare_chains);
+
+  // Lay the chains out in their new order, table now holds where each one continues
+  size_t start = 0;
+
+  for (size_t c = 0; c < num_chains; c++) {
+    segment->chain_starts[c] = start;
+    table[chains[c].id] = start;
+    start += chains[c].len;
+
+    if (c + 1 == num_chains || chains[c + 1].stage != chains[c].stage) {
+      segment->stage_ends[segment->num_stages++] = c + 1;
+    }
+  }
+
+  segment->chain_starts[num_chains] = n;
+
+  for (size_t i = 0; i < n; i++) {
+    segment->order[table[chain_of[i]]++] = i;
+  }
+
+  segment->num_chains = num_chains;
+
+  free(chain_of);
+  free(table);
+  free(chains);
+
+  return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef EMS_SEGMENT_H
+#define EMS_SEGMENT_H
+
+#include <stddef.h>
+
+#include "filehandler.h"
+#include "parser.h"
+
+#define ALL_THREADS (0)  // Thread ID of a WAIT that applies to every thread
+
+// Decoded command of a jobs file
+struct Instruction {
+  enum Command cmd;       // Command type
+  unsigned int event_id;  // Event ID (CREATE, RESERVE, SHOW and STATS)
+  unsigned int arg1;      // Number of rows (CREATE) or delay (WAIT)
+  unsigned int arg2;      // Number of columns (CREATE) or thread ID (WAIT)
+
+  size_t coords;      // Index of the first seat in the coordinate arena (RESERVE)
+  size_t num_coords;  // Number of seats to reserve (RESERVE)
+};
+
+// Commands of a jobs file up to the next barrier
+struct Segment {
+  struct Instruction *instructions;  // Array with the commands in file order
+  size_t num_instructions;           // Number of commands in the segment
+  size_t capacity;                   // Allocated size of the instructions array
+
+  size_t *xs;              // Coordinate arena with the rows of every reservation
+  size_t *ys;              // Coordinate arena with the columns of every reservation
+  size_t num_coords;       // Number of coordinates in the arena
+  size_t coords_capacity;  // Allocated size of the arena
+
+  size_t *order;             // Instruction indexes grouped into chains, each chain in file order
+  size_t *chain_starts;      // Position in order of the first instruction of each chain, plus an end marker
+  size_t num_chains;         // Number of chains, 0 if the segment runs in file order
+  size_t *stage_ends;        // Index of the chain after the last one of each stage
+  size_t num_stages;         // Number of stages, 0 if the segment runs in file order
+  size_t schedule_capacity;  // Allocated size of order, chain_starts and stage_ends
+
+  enum Command end;  // CMD_BARRIER if the segment ended in a barrier, EOC otherwise
+};
+
+/// Initializes an empty segment.
+/// @param segment Segment to be initialized.
+void init_segment(struct Segment *segment);
+
+/// Frees the memory used by a segment.
+/// @param segment Segment to be freed.
+void free_segment(struct Segment *segment);
+
+/// Appends a new instruction to the segment, growing it if needed.
+/// @param segment Segment to be modified.
+/// @return Pointer to the new instruction, NULL if memory ran out.
+struct Instruction *new_instruction(struct Segment *segment);
+
+/// Makes sure the coordinate arena can hold a reservation of the maximum size.
+/// @param segment Segment to be modified.
+/// @return 0 if there is enough space, 1 if memory ran out.
+int reserve_coords(struct Segment *segment);
+
+/// Parses the next command of a jobs file, skipping empty lines.
+/// @param reader Buffered reader of the file to read from.
+/// @param instruction Instruction to store the command in, CMD_BARRIER or EOC
+/// once the segment ends.
+/// @param xs Room for MAX_RESERVATION_SIZE rows, filled by a RESERVE.
+/// @param ys Room for MAX_RESERVATION_SIZE columns, filled by a RESERVE.
+void parse_instruction(struct FileReader *reader, struct Instruction *instruction, size_t *xs, size_t *ys);
+
+/// Parses the commands of a jobs file until the next BARRIER or the end of the
+/// file, replacing the previous contents of the segment.
+/// @param reader Buffered reader of the file to read from.
+/// @param segment Segment to store the commands in.
+/// @return 0 if the segment was parsed successfully, 1 if memory ran out.
+int parse_segment(struct FileReader *reader, struct Segment *segment);
+
+/// Groups the commands of a segment into chains that can run in parallel with
+/// each other. Commands on the same event form one chain in file order, every
+/// other command is a chain of its own. LIST and WAIT are ordering points: each
+/// one is a stage of its own, splitting the rest of the segment into stages
+/// that must run one after the other. Inside a stage, chains are ordered
+/// longest first, so the busiest events start as early as possible.
+/// @param segment Segment to be scheduled.
+/// @return 0 if the segment was scheduled successfully, 1 if memory ran out.
+int schedule_segment(struct Segment *segment);
+
+#endif  // EMS_SEGMENT_H
@@ -1,48 +1,92 @@
 #include "sort.h"
-#include <stdio.h>
 
-#define FALSE (0)
-#define TRUE (1)
+#include <stdint.h>
+#include <string.h>
 
-void exchange(size_t i, size_t j, size_t *xs, size_t *ys) {
-    size_t temp_x = xs[i];
-    size_t temp_y = ys[i];
+#define INSERTION_SORT_THRESHOLD 16 // Below this size insertion sort beats the radix passes
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
 
-    xs[i] = xs[j];
-    ys[i] = ys[j];
+/// Sorts a small array of keys in place.
+static void insertion_sort(uint64_t *keys, size_t size){
+  for(size_t i = 1; i < size; i++){
+    uint64_t key = keys[i];
+    size_t j = i;
 
-    xs[j] = temp_x;
-    ys[j] = temp_y;
+    while(j > 0 && keys[j - 1] > key){
+      keys[j] = keys[j - 1];
+      j--;
+    }
+    keys[j] = key;
+  }
 }
 
-int is_greater_than_next(size_t i, size_t *xs, size_t *ys){
-  if(xs[i] > xs[i + 1])
-    return TRUE;
-  else if(xs[i] == xs[i + 1]){
-    if(ys[i] > ys[i + 1])
-      return TRUE;
-    else if(ys[i] == ys[i + 1])
-      return -1;
-    return FALSE;
-  }
-  return FALSE;
+/// Sorts an array of keys with a least significant digit radix sort, skipping
+/// the digits that are the same in every key.
+/// @param keys Array of keys, sorted on return
+/// @param tmp Scratch array with the same size
+/// @param size Number of keys
+static void radix_sort(uint64_t *keys, uint64_t *tmp, size_t size){
+  uint64_t differ = 0;
+  for(size_t i = 1; i < size; i++){
+    differ |= keys[i] ^ keys[0];
+  }
+
+  uint64_t *from = keys, *to = tmp;
+
+  for(unsigned int shift = 0; shift < 64; shift += RADIX_BITS){
+    if(((differ >> shift) & (RADIX_SIZE - 1)) == 0) continue;
+
+    size_t count[RADIX_SIZE] = {0};
+    for(size_t i = 0; i < size; i++){
+      count[(from[i] >> shift) & (RADIX_SIZE - 1)]++;
+    }
+
+    size_t offset = 0;
+    for(size_t d = 0; d < RADIX_SIZE; d++){
+      size_t c = count[d];
+      count[d] = offset;
+      offset += c;
+    }
+
+    for(size_t i = 0; i < size; i++){
+      to[count[(from[i] >> shift) & (RADIX_SIZE - 1)]++] = from[i];
+    }
+
+    uint64_t *swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if(from != keys){
+    memcpy(keys, from, size * sizeof(uint64_t));
+  }
 }
 
 int sort(size_t *xs, size_t *ys, size_t size){
-  int exchanged;
-  for(size_t i = 0; i < size - 1; i++){
-    exchanged = FALSE;
-    for(size_t j = 0; j < size - i - 1; j++){
-      int compare_result = is_greater_than_next(j, xs, ys);
-      if(compare_result == TRUE){
-        exchange(j, j + 1, xs, ys);
-        exchanged = TRUE;
-      }
-      else if(compare_result == -1){
-        return -1;
-      }
-    }
-    if(exchanged == FALSE) return 0;
+  if(size < 2) return 0;
+
+  // Seats are ordered by row and then by column, so a single key with the row in
+  // the high half and the column in the low half orders them the same way
+  uint64_t keys[size];
+  for(size_t i = 0; i < size; i++){
+    keys[i] = (uint64_t)xs[i] << 32 | (uint64_t)ys[i];
+  }
+
+  if(size <= INSERTION_SORT_THRESHOLD){
+    insertion_sort(keys, size);
   }
+  else{
+    uint64_t tmp[size];
+    radix_sort(keys, tmp, size);
+  }
+
+  for(size_t i = 0; i < size; i++){
+    if(i > 0 && keys[i] == keys[i - 1]) return -1;
+
+    xs[i] = (size_t)(keys[i] >> 32);
+    ys[i] = (size_t)(keys[i] & UINT32_MAX);
+  }
+
   return 0;
-}
\ No newline at end of file
+}
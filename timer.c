@@ -0,0 +1,183 @@
+#include "timer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+uint64_t now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/// Removes the earliest timer from the heap.
+/// @note The heap must not be empty and its lock must be held.
+static struct Timer pop_timer(struct TimerQueue *queue) {
+  struct Timer earliest = queue->heap[0];
+  struct Timer last = queue->heap[--queue->size];
+
+  // Sift the last timer down from the root
+  size_t i = 0;
+  while (2 * i + 1 < queue->size) {
+    size_t child = 2 * i + 1;
+    if (child + 1 < queue->size && queue->heap[child + 1].deadline < queue->heap[child].deadline) child++;
+    if (last.deadline <= queue->heap[child].deadline) break;
+
+    queue->heap[i] = queue->heap[child];
+    i = child;
+  }
+
+  if (queue->size > 0) queue->heap[i] = last;
+
+  return earliest;
+}
+
+int init_timers(struct TimerQueue *queue) {
+  queue->heap = NULL;
+  queue->size = 0;
+  queue->capacity = 0;
+
+  if (pthread_mutex_init(&queue->lock, NULL) != 0) return 1;
+
+  // Deadlines are on the monotonic clock, so the waits must be too
+  pthread_condattr_t attr;
+  if (pthread_condattr_init(&attr) != 0) {
+    pthread_mutex_destroy(&queue->lock);
+    return 1;
+  }
+
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int ret = pthread_cond_init(&queue->change, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (ret != 0) {
+    pthread_mutex_destroy(&queue->lock);
+    return 1;
+  }
+
+  return 0;
+}
+
+void destroy_timers(struct TimerQueue *queue) {
+  pthread_cond_destroy(&queue->change);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->heap);
+  queue->heap = NULL;
+  queue->size = 0;
+  queue->capacity = 0;
+}
+
+int add_timer(struct TimerQueue *queue, unsigned int delay_ms, size_t unit, size_t pos) {
+  struct Timer timer = {now_ns() + (uint64_t)delay_ms * 1000000, unit, pos};
+
+  if (pthread_mutex_lock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  if (queue->size == queue->capacity) {
+    size_t capacity = queue->capacity == 0 ? 16 : queue->capacity * 2;
+    struct Timer *heap = realloc(queue->heap, capacity * sizeof(struct Timer));
+
+    if (heap == NULL) {
+      pthread_mutex_unlock(&queue->lock);
+      return 1;
+    }
+
+    queue->heap = heap;
+    queue->capacity = capacity;
+  }
+
+  // Sift the new timer up from the last leaf
+  size_t i = queue->size++;
+  while (i > 0 && queue->heap[(i - 1) / 2].deadline > timer.deadline) {
+    queue->heap[i] = queue->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  queue->heap[i] = timer;
+
+  pthread_cond_broadcast(&queue->change);
+
+  if (pthread_mutex_unlock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  return 0;
+}
+
+int take_expired_timer(struct TimerQueue *queue, struct Timer *timer) {
+  if (pthread_mutex_lock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  int taken = queue->size > 0 && queue->heap[0].deadline <= now_ns();
+
+  if (taken) {
+    *timer = pop_timer(queue);
+  }
+
+  if (pthread_mutex_unlock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  return taken;
+}
+
+int next_deadline(struct TimerQueue *queue, uint64_t *deadline) {
+  if (pthread_mutex_lock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  int found = queue->size > 0;
+
+  if (found) {
+    *deadline = queue->heap[0].deadline;
+  }
+
+  if (pthread_mutex_unlock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  return found;
+}
+
+int wait_timer(struct TimerQueue *queue, struct Timer *timer) {
+  if (pthread_mutex_lock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  int taken = 0;
+
+  while (queue->size > 0) {
+    uint64_t deadline = queue->heap[0].deadline;
+
+    if (deadline <= now_ns()) {
+      *timer = pop_timer(queue);
+      taken = 1;
+      break;
+    }
+
+    // Wake up at the deadline, or earlier if a sooner timer is added
+    struct timespec until = {(time_t)(deadline / 1000000000), (long)(deadline % 1000000000)};
+    int ret = pthread_cond_timedwait(&queue->change, &queue->lock, &until);
+
+    if (ret != 0 && ret != ETIMEDOUT) {
+      fprintf(stderr, "Failed to wait on condition\n");
+      exit(1);
+    }
+  }
+
+  if (pthread_mutex_unlock(&queue->lock) != 0) {
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  return taken;
+}
@@ -0,0 +1,64 @@
+#ifndef EMS_TIMER_H
+#define EMS_TIMER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Commands deferred by a WAIT, waiting for their delay to pass
+struct Timer {
+  uint64_t deadline;  // CLOCK_MONOTONIC time in nanoseconds when the command may run
+  size_t unit;        // Chain, or command, the deferred command belongs to
+  size_t pos;         // Position of the deferred command in the unit
+};
+
+// Min-heap of deferred commands ordered by deadline
+struct TimerQueue {
+  pthread_mutex_t lock;   // Protects every field below
+  pthread_cond_t change;  // Signaled when a timer is added, so waiters can look at the new earliest one
+
+  struct Timer *heap;  // Heap of timers, the earliest one first
+  size_t size;         // Number of timers
+  size_t capacity;     // Allocated size of the heap
+};
+
+/// Gets the current CLOCK_MONOTONIC time.
+/// @return Time in nanoseconds.
+uint64_t now_ns();
+
+/// Initializes an empty timer queue.
+/// @param queue Queue to be initialized.
+/// @return 0 if the queue was initialized successfully, 1 otherwise.
+int init_timers(struct TimerQueue *queue);
+
+/// Frees the memory used by a timer queue.
+/// @param queue Queue to be destroyed.
+void destroy_timers(struct TimerQueue *queue);
+
+/// Defers a command until a delay has passed.
+/// @param queue Queue to add the timer to.
+/// @param delay_ms Delay in milliseconds.
+/// @param unit Chain, or command, the deferred command belongs to.
+/// @param pos Position of the deferred command in the unit.
+/// @return 0 if the command was deferred, 1 if memory ran out.
+int add_timer(struct TimerQueue *queue, unsigned int delay_ms, size_t unit, size_t pos);
+
+/// Takes the earliest deferred command if its delay has already passed.
+/// @param queue Queue to take the timer from.
+/// @param timer Where to store the timer taken.
+/// @return 1 if a timer was taken, 0 if none has expired.
+int take_expired_timer(struct TimerQueue *queue, struct Timer *timer);
+
+/// Gets when the earliest deferred command may run.
+/// @param queue Queue to look at.
+/// @param deadline Where to store the CLOCK_MONOTONIC time in nanoseconds.
+/// @return 1 if a command is deferred, 0 if the queue is empty.
+int next_deadline(struct TimerQueue *queue, uint64_t *deadline);
+
+/// Waits for the earliest deferred command and takes it once its delay passes.
+/// @param queue Queue to take the timer from.
+/// @param timer Where to store the timer taken.
+/// @return 1 if a timer was taken, 0 if the queue is empty.
+int wait_timer(struct TimerQueue *queue, struct Timer *timer);
+
+#endif  // EMS_TIMER_H
@@ -0,0 +1,195 @@
+#include "writer.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+/// Writes a batch of blocks with as few system calls as possible.
+/// @param fd File descriptor to write to.
+/// @param iov Blocks to be written, modified as they are consumed.
+/// @param n Number of blocks.
+/// @return 0 if every block was written, 1 otherwise.
+static int write_blocks(int fd, struct iovec *iov, size_t n) {
+  size_t first = 0;
+
+  while (first < n) {
+    long int bytes_written = writev(fd, iov + first, (int)(n - first));
+
+    if (bytes_written < 0) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+
+    // Skip what was written, which may end in the middle of a block
+    size_t done = (size_t)bytes_written;
+    while (first < n && done >= iov[first].iov_len) {
+      done -= iov[first].iov_len;
+      first++;
+    }
+
+    if (first < n) {
+      iov[first].iov_base = (char *)iov[first].iov_base + done;
+      iov[first].iov_len -= done;
+    }
+  }
+
+  return 0;
+}
+
+/// Takes every queued block and writes them together until the writer is stopped.
+static void *write_output(void *arg) {
+  struct OutputWriter *writer = (struct OutputWriter *)arg;
+  struct OutputBlock batch[OUTPUT_QUEUE_SIZE];
+  struct iovec iov[OUTPUT_QUEUE_SIZE];
+
+  while (1) {
+    if (pthread_mutex_lock(&writer->lock) != 0) {
+      fprintf(stderr, "Failed to lock mutex\n");
+      exit(1);
+    }
+
+    while (writer->count == 0 && !writer->stopping) {
+      pthread_cond_wait(&writer->not_empty, &writer->lock);
+    }
+
+    size_t n = writer->count;
+    for (size_t i = 0; i < n; i++) {
+      batch[i] = writer->blocks[(writer->head + i) % OUTPUT_QUEUE_SIZE];
+    }
+
+    writer->head = (writer->head + n) % OUTPUT_QUEUE_SIZE;
+    writer->count = 0;
+    int failed = writer->failed;
+
+    pthread_cond_broadcast(&writer->not_full);
+
+    if (pthread_mutex_unlock(&writer->lock) != 0) {
+      fprintf(stderr, "Failed to unlock mutex\n");
+      exit(1);
+    }
+
+    // Only empty once stopping, since the wait above ends with blocks otherwise
+    if (n == 0) {
+      return NULL;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      iov[i].iov_base = batch[i].data;
+      iov[i].iov_len = batch[i].len;
+    }
+
+    if (!failed && write_blocks(writer->fd, iov, n) != 0) {
+      fprintf(stderr, "Error while writing to file.\n");
+
+      if (pthread_mutex_lock(&writer->lock) != 0) {
+        fprintf(stderr, "Failed to lock mutex\n");
+        exit(1);
+      }
+
+      writer->failed = 1;
+
+      if (pthread_mutex_unlock(&writer->lock) != 0) {
+        fprintf(stderr, "Failed to unlock mutex\n");
+        exit(1);
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      free(batch[i].data);
+    }
+  }
+}
+
+int start_writer(struct OutputWriter *writer, int fd) {
+  writer->fd = fd;
+  writer->head = 0;
+  writer->count = 0;
+  writer->stopping = 0;
+  writer->failed = 0;
+
+  if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+    return 1;
+  }
+
+  if (pthread_cond_init(&writer->not_empty, NULL) != 0) {
+    pthread_mutex_destroy(&writer->lock);
+    return 1;
+  }
+
+  if (pthread_cond_init(&writer->not_full, NULL) != 0) {
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_mutex_destroy(&writer->lock);
+    return 1;
+  }
+
+  if (pthread_create(&writer->thread, NULL, &write_output, writer) != 0) {
+    pthread_cond_destroy(&writer->not_full);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_mutex_destroy(&writer->lock);
+    return 1;
+  }
+
+  return 0;
+}
+
+int submit_output(struct OutputWriter *writer, struct OutputBuffer *buffer) {
+  if (pthread_mutex_lock(&writer->lock) != 0) {
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  while (writer->count == OUTPUT_QUEUE_SIZE && !writer->failed) {
+    pthread_cond_wait(&writer->not_full, &writer->lock);
+  }
+
+  int failed = writer->failed;
+
+  if (!failed) {
+    struct OutputBlock *block = &writer->blocks[(writer->head + writer->count) % OUTPUT_QUEUE_SIZE];
+    block->data = buffer->data;
+    block->len = buffer->len;
+    writer->count++;
+
+    pthread_cond_signal(&writer->not_empty);
+  }
+
+  if (pthread_mutex_unlock(&writer->lock) != 0) {
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  if (failed) {
+    buffer->len = 0;
+    return 1;
+  }
+
+  buffer->data = NULL;
+  buffer->len = 0;
+  buffer->capacity = 0;
+
+  return 0;
+}
+
+int stop_writer(struct OutputWriter *writer) {
+  if (pthread_mutex_lock(&writer->lock) != 0) {
+    fprintf(stderr, "Failed to lock mutex\n");
+    exit(1);
+  }
+
+  writer->stopping = 1;
+  pthread_cond_signal(&writer->not_empty);
+
+  if (pthread_mutex_unlock(&writer->lock) != 0) {
+    fprintf(stderr, "Failed to unlock mutex\n");
+    exit(1);
+  }
+
+  pthread_join(writer->thread, NULL);
+
+  pthread_cond_destroy(&writer->not_full);
+  pthread_cond_destroy(&writer->not_empty);
+  pthread_mutex_destroy(&writer->lock);
+
+  return writer->failed;
+}
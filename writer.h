@@ -0,0 +1,52 @@
+#ifndef EMS_WRITER_H
+#define EMS_WRITER_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "constants.h"
+#include "filehandler.h"
+
+// Output of one command, written as a whole
+struct OutputBlock {
+  char *data;  // Rendered output, owned by the queue until written
+  size_t len;  // Number of bytes to write
+};
+
+// Thread that writes the output of a jobs file, fed through a bounded queue
+struct OutputWriter {
+  int fd;            // File descriptor of the .out file
+  pthread_t thread;  // Thread doing the writes
+
+  pthread_mutex_t lock;      // Protects every field below
+  pthread_cond_t not_empty;  // Signaled when a block is queued or the writer is stopped
+  pthread_cond_t not_full;   // Signaled when blocks are taken from the queue
+
+  struct OutputBlock blocks[OUTPUT_QUEUE_SIZE];  // Circular queue of blocks in submission order
+  size_t head;   // Position of the oldest queued block
+  size_t count;  // Number of queued blocks
+  int stopping;  // 1 once no more blocks will be submitted
+  int failed;    // 1 if any write failed
+};
+
+/// Starts the writer thread of a file.
+/// @param writer Writer to be started.
+/// @param fd File descriptor of the file to write to.
+/// @return 0 if the writer was started successfully, 1 otherwise.
+int start_writer(struct OutputWriter *writer, int fd);
+
+/// Hands the contents of an output buffer to the writer, to be written with no
+/// other output in between. Blocks while the queue is full.
+/// @param writer Writer of the file.
+/// @param buffer Buffer with the output. Its memory now belongs to the writer
+/// and the buffer is left empty.
+/// @return 0 if the output was queued, 1 if it was dropped because a previous
+/// write failed.
+int submit_output(struct OutputWriter *writer, struct OutputBuffer *buffer);
+
+/// Writes every queued block and stops the writer thread.
+/// @param writer Writer to be stopped.
+/// @return 0 if all the output was written, 1 if any write failed.
+int stop_writer(struct OutputWriter *writer);
+
+#endif  // EMS_WRITER_H